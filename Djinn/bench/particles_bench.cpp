@@ -0,0 +1,265 @@
+// Benchmarks of the particle simulation modules. They don't need a window or a GL context,
+// so they can run on a build machine:
+//
+//   particles_bench [max_particles]
+//
+// max_particles (default 10M) caps the emitter benchmarks, 10M smoke particles need about 3 GB.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <execution>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <common/CollisionMesh.h>
+#include <common/ParticleGrid.h>
+#include <common/SmokeEmitter.h>
+#include <common/CoinRainEmitter.h>
+#include <common/SmokeFluidSolver.h>
+
+using namespace std;
+using namespace glm;
+
+// Float milliseconds since start
+static float elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// A bumpy floor of size x size quads (2 triangles each) plus a table-like box on it,
+// about the triangle count of the table and the lamp together
+static void buildScene(CollisionMesh& mesh, int size) {
+    vector<vec3> vertices;
+    vector<unsigned int> indices;
+    for (int z = 0; z <= size; z++) {
+        for (int x = 0; x <= size; x++) {
+            float fx = -10.0f + 20.0f * x / size;
+            float fz = -10.0f + 20.0f * z / size;
+            vertices.push_back(vec3(fx, -3.4f + 0.05f * sin(fx * 3.0f) * cos(fz * 3.0f), fz));
+        }
+    }
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            unsigned int i = z * (size + 1) + x;
+            indices.insert(indices.end(), { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 });
+        }
+    }
+    mesh.addTriangles(vertices, indices);
+
+    // Table top
+    vector<vec3> top = { vec3(-3, -0.5f, -2.5f), vec3(3, -0.5f, -2.5f), vec3(3, -0.5f, 2.5f), vec3(-3, -0.5f, 2.5f) };
+    mesh.addTriangles(top, { 0, 2, 1, 0, 3, 2 });
+}
+
+static void benchCollision() {
+    CollisionMesh mesh;
+    buildScene(mesh, 256);
+
+    auto start = chrono::steady_clock::now();
+    mesh.build();
+    float build_ms = elapsedMs(start);
+
+    cout << "CollisionMesh: " << mesh.triangleCount() << " triangles, " << mesh.nodeCount()
+         << " BVH nodes, built in " << build_ms << " ms" << endl;
+
+    mt19937 rng(1);
+    uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (int particles : { 100000, 1000000 }) {
+        // One simulation step (1/60 s) of coins falling at up to 20 m/s from anywhere in the room
+        vector<vec3> from(particles), to(particles);
+        vector<float> radius(particles);
+        for (int i = 0; i < particles; i++) {
+            from[i] = vec3(-10 + 20 * uniform(rng), -3.5f + 8 * uniform(rng), -10 + 20 * uniform(rng));
+            to[i] = from[i] + vec3(uniform(rng) - 0.5f, -20.0f * uniform(rng), uniform(rng) - 0.5f) / 60.0f;
+            radius[i] = 0.13f * (0.5f + uniform(rng));
+        }
+
+        vector<collisionHit> hits;
+        mesh.sweepSpheres(from, to, radius, hits); // warm up
+
+        const int runs = 5;
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) {
+            mesh.sweepSpheres(from, to, radius, hits);
+        }
+        float ms = elapsedMs(start) / runs;
+
+        int contacts = 0;
+        for (const auto& hit : hits) {
+            if (hit.t < 1.0f) contacts++;
+        }
+
+        cout << "  " << setw(8) << particles << " swept spheres: " << fixed << setprecision(2) << ms << " ms, "
+             << setprecision(1) << particles / (ms * 1.0e3f) << " M queries/s, " << contacts << " contacts" << endl;
+        cout << defaultfloat << setprecision(6);
+    }
+}
+
+static void benchGrid() {
+    // Cells of two coin radii (mass 1.5), about one coin in every two cells like a loose pile
+    const float cell_size = 2.0f * 0.13f * 1.5f;
+    ParticleGrid grid(cell_size);
+
+    cout << "ParticleGrid: cell size " << cell_size << endl;
+
+    mt19937 rng(1);
+    uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (int particles : { 10000, 100000, 1000000 }) {
+        float side = cell_size * cbrt(particles * 2.0f);
+        vector<vec3> positions(particles);
+        for (auto& p : positions) p = vec3(uniform(rng), uniform(rng), uniform(rng)) * side;
+
+        grid.build(positions); // warm up, allocates the buckets
+
+        const int runs = 5;
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) grid.build(positions);
+        float build_ms = elapsedMs(start) / runs;
+
+        // Number of particles within cell_size of every particle, in the order of the grid like the coins
+        vector<int> neighbors(particles);
+        gridRange order = grid.particles();
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) {
+            for_each(execution::par, order.begin(), order.end(), [&](int i) {
+                vec3 p = positions[i];
+                int count = 0;
+                grid.forEachNeighbor(p, [&](int j) {
+                    vec3 d = positions[j] - p;
+                    if (dot(d, d) < cell_size * cell_size) count++;
+                });
+                neighbors[i] = count - 1;
+            });
+        }
+        float query_ms = elapsedMs(start) / runs;
+
+        long long total = 0;
+        for (int c : neighbors) total += c;
+
+        cout << "  " << setw(8) << particles << " particles: rebuild " << fixed << setprecision(2) << build_ms
+             << " ms (" << setprecision(1) << build_ms * 1.0e6f / particles << " ns/particle), query "
+             << setprecision(2) << query_ms << " ms (" << setprecision(1) << query_ms * 1.0e6f / particles
+             << " ns/particle), " << setprecision(2) << (float)total / particles << " neighbors/particle" << endl;
+        cout << defaultfloat << setprecision(6);
+
+        // The pairwise loop that the grid replaces, only affordable at the smallest count
+        if (particles <= 10000) {
+            atomic<long long> pairs(0);
+            start = chrono::steady_clock::now();
+            for_each(execution::par, positions.begin(), positions.end(), [&](const vec3& p) {
+                int count = 0;
+                for (const vec3& q : positions) {
+                    vec3 d = q - p;
+                    if (dot(d, d) < cell_size * cell_size) count++;
+                }
+                pairs += count - 1;
+            });
+            cout << "  " << setw(8) << particles << " particles: pairwise query " << elapsedMs(start)
+                 << " ms, " << (float)pairs / particles << " neighbors/particle" << endl;
+        }
+    }
+}
+
+// Steps of the smoke solver over the box of the scene at a few resolutions
+static void benchFluid() {
+    cout << "SmokeFluidSolver:" << endl;
+
+    for (float cell_size : { 0.4f, 0.2f, 0.1f }) {
+        SmokeFluidSolver fluid(vec3(-3.0f, -1.0f, -4.0f), vec3(8.0f, 6.0f, 4.0f), cell_size);
+        fluid.wind = vec3(1.5f, 0.0f, 0.0f);
+
+        const int steps = 10;
+        fluidTimings total;
+        for (int s = 0; s < steps; s++) {
+            fluid.step(1.0f / 60.0f);
+            total.forces_ms += fluid.timings.forces_ms;
+            total.advect_ms += fluid.timings.advect_ms;
+            total.divergence_ms += fluid.timings.divergence_ms;
+            total.pressure_ms += fluid.timings.pressure_ms;
+            total.project_ms += fluid.timings.project_ms;
+            total.total_ms += fluid.timings.total_ms;
+        }
+        fluid.timings = total;
+        fluid.timings.forces_ms /= steps;
+        fluid.timings.advect_ms /= steps;
+        fluid.timings.divergence_ms /= steps;
+        fluid.timings.pressure_ms /= steps;
+        fluid.timings.project_ms /= steps;
+        fluid.timings.total_ms /= steps;
+
+        cout << "  " << setw(8) << fluid.cellCount() << " cells, ";
+        fluid.report(cout);
+    }
+}
+
+// Spawns every particle at once instead of the ramp up of updateParticles
+template<typename Emitter>
+class FilledEmitter : public Emitter {
+public:
+    FilledEmitter(int number) : Emitter(number) {
+        this->seed(1);
+        this->active_particles += this->spawnParticles(number);
+    }
+};
+
+// Update and back to front sort of one frame, like the particle system does them
+template<typename Emitter>
+static void benchEmitter(const char* name, int max_particles, void (*setup)(Emitter&)) {
+    cout << name << ":" << endl;
+
+    const float dt = 1.0f / 60.0f;
+    const vec3 camera_pos(0, 3, 8);
+
+    for (int particles = 1000; particles <= max_particles; particles *= 10) {
+        FilledEmitter<Emitter> emitter(particles);
+        setup(emitter);
+        emitter.updateParticles(0.0f, dt, camera_pos); // warm up
+
+        // Enough frames to time the small counts, few for the big ones
+        int frames = std::max(3, std::min(100, 10000000 / particles));
+        float update_ms = 0.0f, sort_ms = 0.0f;
+        for (int f = 1; f <= frames; f++) {
+            auto start = chrono::steady_clock::now();
+            emitter.updateParticles(f * dt, dt, camera_pos);
+            update_ms += elapsedMs(start);
+
+            start = chrono::steady_clock::now();
+            emitter.sortAliveList();
+            sort_ms += elapsedMs(start);
+        }
+        update_ms /= frames;
+        sort_ms /= frames;
+
+        int live = emitter.alive_list.size();
+        cout << "  " << setw(8) << particles << " particles (" << live << " live): update " << fixed << setprecision(3)
+             << update_ms << " ms, " << setprecision(1) << update_ms * 1.0e6f / std::max(live, 1) << " ns/particle, "
+             << setprecision(1) << live / (update_ms * 1.0e3f) << " M particles/s, sort " << setprecision(3) << sort_ms
+             << " ms, memory " << setprecision(1) << emitter.memoryUsage() / (1024.0f * 1024.0f) << " MB" << endl;
+        cout << defaultfloat << setprecision(6);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int max_particles = argc > 1 ? stoi(argv[1]) : 10000000;
+
+    benchEmitter<SmokeEmitter>("SmokeEmitter", max_particles, [](SmokeEmitter& e) {
+        e.emitter_pos = vec3(-2.4f, 0.3f, 0.0f);
+    });
+    // Without the scene and the separation, those have their own benchmarks below
+    benchEmitter<CoinRainEmitter>("CoinRainEmitter", max_particles, [](CoinRainEmitter& e) {
+        e.emitter_pos = vec3(0.0f, 20.0f, 0.0f);
+        e.use_separation = false;
+    });
+
+    benchCollision();
+    benchGrid();
+    benchFluid();
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "Bench.h"
+#include "texture.h"
+#include "camera.h"
+#include "OffscreenContext.h"
+#include "TextureManager.h"
+#include <glfw3.h>
+#include <SOIL.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <sys/resource.h>
+
+//The script names of the keys in pollKeyboard
+static int eventKey(const std::string& name) {
+    static const std::map<std::string, int> keys = {
+        { "tremble", GLFW_KEY_1 },
+        { "smoke", GLFW_KEY_2 },
+        { "coins", GLFW_KEY_3 },
+        { "billboards", GLFW_KEY_B },
+        { "oit", GLFW_KEY_O },
+        { "fluid", GLFW_KEY_F },
+        { "pile", GLFW_KEY_C },
+        { "pause", GLFW_KEY_P },
+    };
+    auto found = keys.find(name);
+    return found == keys.end() ? -1 : found->second;
+}
+
+BenchScript BenchScript::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can't open the bench script: " + path);
+    }
+
+    BenchScript script;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) continue;
+
+        bool ok;
+        if (command == "frames") {
+            ok = (bool) (words >> script.frames);
+        }
+        else if (command == "warmup") {
+            ok = (bool) (words >> script.warmup_frames);
+        }
+        else if (command == "camera") {
+            benchCameraKey key;
+            ok = (bool) (words >> key.frame >> key.position.x >> key.position.y >> key.position.z >> key.horizontal_angle >> key.vertical_angle);
+            if (ok) script.camera.push_back(key);
+        }
+        else if (command == "event") {
+            benchEvent event;
+            std::string name;
+            ok = (bool) (words >> event.frame >> name);
+            event.key = eventKey(name);
+            ok = ok && event.key >= 0;
+            if (ok) script.events.push_back(event);
+        }
+        else if (command == "capture") {
+            int frame;
+            ok = (bool) (words >> frame);
+            if (ok) script.captures.push_back(frame);
+        }
+        else {
+            ok = false;
+        }
+        if (!ok) {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": can't parse \"" + line + "\"");
+        }
+    }
+
+    std::stable_sort(script.camera.begin(), script.camera.end(), [](const benchCameraKey& a, const benchCameraKey& b) {
+        return a.frame < b.frame;
+    });
+    return script;
+}
+
+bool BenchScript::cameraAt(int frame, glm::vec3& position, float& horizontal_angle, float& vertical_angle) const {
+    if (camera.empty()) return false;
+
+    //Before the first and after the last keyframe the camera holds still
+    const benchCameraKey* a = &camera.front();
+    const benchCameraKey* b = a;
+    for (const benchCameraKey& key : camera) {
+        b = &key;
+        if (key.frame > frame) break;
+        a = &key;
+    }
+    float t = b->frame > a->frame ? glm::clamp(float(frame - a->frame) / float(b->frame - a->frame), 0.0f, 1.0f) : 0.0f;
+    position = glm::mix(a->position, b->position, t);
+    horizontal_angle = glm::mix(a->horizontal_angle, b->horizontal_angle, t);
+    vertical_angle = glm::mix(a->vertical_angle, b->vertical_angle, t);
+    return true;
+}
+
+std::vector<int> BenchScript::keysAt(int frame) const {
+    std::vector<int> keys;
+    for (const benchEvent& event : events) {
+        if (event.frame == frame) keys.push_back(event.key);
+    }
+    return keys;
+}
+
+bool BenchScript::captureAt(int frame) const {
+    return std::find(captures.begin(), captures.end(), frame) != captures.end();
+}
+
+void BenchReport::sampleMemory(size_t texture_bytes) {
+    peak_texture_bytes = std::max(peak_texture_bytes, texture_bytes);
+
+    //Kilobytes on Linux
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) peak_rss_kb = std::max(peak_rss_kb, (long) usage.ru_maxrss);
+}
+
+bool BenchReport::passed() const {
+    for (const benchCapture& capture : captures) {
+        if (!capture.matches()) return false;
+    }
+    return true;
+}
+
+static std::string hex(uint64_t value) {
+    std::ostringstream text;
+    text << std::hex << std::setw(16) << std::setfill('0') << value;
+    return text.str();
+}
+
+//The names are ours, but a quote or a backslash would break the JSON
+static std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+void BenchReport::write(std::ostream& out, const std::string& script, const std::map<std::string, profileStat>& passes) const {
+    std::vector<float> sorted = frame_ms;
+    std::sort(sorted.begin(), sorted.end());
+    //Nearest rank
+    auto percentile = [&sorted](float p) {
+        if (sorted.empty()) return 0.0f;
+        int rank = (int) std::ceil(p / 100.0f * sorted.size());
+        return sorted[std::max(0, std::min(rank, (int) sorted.size()) - 1)];
+    };
+    double sum = 0.0;
+    for (float ms : sorted) sum += ms;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"script\": " << quoted(script) << ",\n";
+    out << "  \"frames\": " << sorted.size() << ",\n";
+    out << "  \"frame_ms\": { \"mean\": " << (sorted.empty() ? 0.0 : sum / sorted.size())
+        << ", \"p50\": " << percentile(50) << ", \"p95\": " << percentile(95) << ", \"p99\": " << percentile(99)
+        << ", \"max\": " << (sorted.empty() ? 0.0f : sorted.back()) << " },\n";
+
+    //Average per frame over the measured frames, the GPU times over the frames that had a result
+    out << "  \"passes\": {";
+    bool first = true;
+    for (const auto& entry : passes) {
+        const profileStat& stat = entry.second;
+        if (stat.frames == 0) continue;
+        out << (first ? "\n" : ",\n") << "    " << quoted(entry.first) << ": { \"cpu_ms\": " << stat.total_cpu_ms / stat.frames;
+        if (stat.gpu_frames > 0) out << ", \"gpu_ms\": " << stat.total_gpu_ms / stat.gpu_frames;
+        out << " }";
+        first = false;
+    }
+    out << "\n  },\n";
+
+    out << "  \"memory\": { \"peak_rss_kb\": " << peak_rss_kb << ", \"peak_texture_bytes\": " << peak_texture_bytes << " },\n";
+
+    out << "  \"captures\": [";
+    for (int i = 0; i < captures.size(); i++) {
+        const benchCapture& capture = captures[i];
+        out << (i == 0 ? "\n" : ",\n") << "    { \"frame\": " << capture.frame << ", \"hash\": \"" << hex(capture.hash) << "\", \"golden\": "
+            << (capture.has_expected ? "\"" + hex(capture.expected) + "\"" : std::string("null"))
+            << ", \"match\": " << (capture.matches() ? "true" : "false") << " }";
+    }
+    out << (captures.empty() ? "],\n" : "\n  ],\n");
+    out << "  \"passed\": " << (passed() ? "true" : "false") << "\n";
+    out << "}\n";
+}
+
+uint64_t hashImage(const std::vector<unsigned char>& pixels) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char byte : pixels) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string goldenPath(const std::string& directory, int frame, const char* extension) {
+    return (std::filesystem::path(directory) / ("frame_" + std::to_string(frame) + extension)).string();
+}
+
+bool readGoldenHash(const std::string& directory, int frame, uint64_t& hash) {
+    std::ifstream file(goldenPath(directory, frame, ".hash"));
+    if (!file.is_open()) return false;
+    return (bool) (file >> std::hex >> hash);
+}
+
+void writeGoldenFrame(const std::string& directory, int frame, uint64_t hash, const std::vector<unsigned char>& rgba, int width, int height) {
+    std::filesystem::create_directories(directory);
+    std::ofstream file(goldenPath(directory, frame, ".hash"), std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can't write the golden frame: " + goldenPath(directory, frame, ".hash"));
+    }
+    file << hex(hash) << std::endl;
+
+    //glReadPixels starts at the bottom row, the image file at the top one
+    std::vector<unsigned char> flipped(rgba.size());
+    size_t row = (size_t) width * 4;
+    for (int y = 0; y < height; y++) {
+        std::copy_n(&rgba[(height - 1 - y) * row], row, &flipped[y * row]);
+    }
+    std::lock_guard<std::mutex> lock(soilMutex());
+    SOIL_save_image(goldenPath(directory, frame, ".tga").c_str(), SOIL_SAVE_TYPE_TGA, width, height, 4, flipped.data());
+}
+
+bool benchOptions::parse(int argc, char** argv, int& i) {
+    std::string option = argv[i];
+    bool has_value = i + 1 < argc;
+    if (option == "--script" && has_value) script_path = argv[++i];
+    else if (option == "--frames" && has_value) frames = std::stoi(argv[++i]);
+    else if (option == "--out" && has_value) output_path = argv[++i];
+    else if (option == "--golden" && has_value) golden_directory = argv[++i];
+    else if (option == "--update-golden") update_golden = true;
+    else return false;
+    return true;
+}
+
+bool runBench(const benchOptions& options, Camera& camera, OffscreenContext& context, float fixed_dt,
+              const std::function<void(int key)>& pressKey, const std::function<void(float dt)>& frame) {
+    BenchScript script = BenchScript::load(options.script_path);
+    if (options.frames > 0) script.frames = options.frames;
+    if (options.update_golden && options.golden_directory.empty()) {
+        throw std::runtime_error("--update-golden needs --golden <dir>");
+    }
+
+    BenchReport report;
+    float previous_time = 0.0f;
+    for (int i = 0; i < script.frames; i++) {
+        //The timings of the last frame are closed, the averages of the report start after the warm-up
+        Profiler::instance().beginFrame();
+        if (i == script.warmup_frames) Profiler::instance().resetTotals();
+        auto frame_start = std::chrono::steady_clock::now();
+
+        for (int key : script.keysAt(i)) pressKey(key);
+        script.cameraAt(i, camera.position, camera.horizontalAngle, camera.verticalAngle);
+        camera.updateMatrices();
+
+        float time = i * fixed_dt;
+        frame(time - previous_time);
+        previous_time = time;
+
+        //Nothing is swapped, glFinish waits for the GPU so that the frame time includes its work
+        {
+            ProfileScope scope("finish");
+            glFinish();
+        }
+        float frame_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        if (i >= script.warmup_frames) report.addFrame(frame_ms);
+        const textureManagerStats& textures = TextureManager::instance().stats();
+        report.sampleMemory(textures.gpu_bytes + textures.fixed_bytes);
+
+        if (script.captureAt(i)) {
+            std::vector<unsigned char> pixels = context.readPixels();
+            benchCapture capture;
+            capture.frame = i;
+            capture.hash = hashImage(pixels);
+            if (options.update_golden) {
+                writeGoldenFrame(options.golden_directory, i, capture.hash, pixels, context.width, context.height);
+            }
+            else if (!options.golden_directory.empty()) {
+                capture.has_expected = readGoldenHash(options.golden_directory, i, capture.expected);
+            }
+            report.addCapture(capture);
+        }
+    }
+
+    //Closes the last frame, its timings go to the totals
+    Profiler::instance().beginFrame();
+
+    std::ofstream results(options.output_path, std::ios::out | std::ios::trunc);
+    if (!results.is_open()) {
+        throw std::runtime_error("Can't write the results: " + options.output_path);
+    }
+    report.write(results, options.script_path, Profiler::instance().stats());
+    bool passed = report.passed();
+    std::cout << "Results of " << script.frames << " frames written to " << options.output_path
+              << (passed ? "" : ", the golden frames don't match") << std::endl;
+    return passed;
+}
@@ -0,0 +1,119 @@
+#ifndef VVR_OGL_LABORATORY_BENCH_H
+#define VVR_OGL_LABORATORY_BENCH_H
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <glm/glm.hpp>
+#include "Profiler.h"
+
+class Camera;
+class OffscreenContext;
+
+//A keyframe of the scripted camera, it moves linearly between the keyframes
+struct benchCameraKey {
+    int frame;
+    glm::vec3 position;
+    float horizontal_angle;
+    float vertical_angle;
+};
+
+//A key that is pressed at the start of a frame, the same as pressing it in the window
+struct benchEvent {
+    int frame;
+    int key;
+};
+
+/**
+* What djinn_bench does, from a text file: the number of frames, the camera path, the key presses
+* (the same actions as the keys of the window) and the frames whose image is compared to a golden one.
+*
+*   # comment
+*   frames 600
+*   warmup 30                         (frames left out of the statistics)
+*   camera <frame> <x> <y> <z> <horizontal angle> <vertical angle>
+*   event <frame> tremble | smoke | coins | billboards | oit | fluid | pile | pause
+*   capture <frame>
+*/
+class BenchScript {
+public:
+    int frames = 600;
+    int warmup_frames = 30;
+    std::vector<benchCameraKey> camera;
+    std::vector<benchEvent> events;
+    std::vector<int> captures;
+
+    //Throws runtime_error for a file that can't be read or a line that can't be parsed
+    static BenchScript load(const std::string& path);
+
+    //false without camera keyframes, the camera then stays where it is
+    bool cameraAt(int frame, glm::vec3& position, float& horizontal_angle, float& vertical_angle) const;
+    //The keys of this frame, in the order of the script
+    std::vector<int> keysAt(int frame) const;
+    bool captureAt(int frame) const;
+};
+
+//The image of a capture frame against the golden one (no expected hash: no golden file)
+struct benchCapture {
+    int frame;
+    uint64_t hash;
+    uint64_t expected = 0;
+    bool has_expected = false;
+    bool matches() const { return !has_expected || hash == expected; }
+};
+
+//Frame times and memory of a run, written as JSON together with the per pass times of the profiler
+class BenchReport {
+public:
+    void addFrame(float ms) { frame_ms.push_back(ms); }
+    //Called every frame, keeps the highest values
+    void sampleMemory(size_t texture_bytes);
+    void addCapture(const benchCapture& capture) { captures.push_back(capture); }
+
+    //Every capture with a golden hash matched it
+    bool passed() const;
+    void write(std::ostream& out, const std::string& script, const std::map<std::string, profileStat>& passes) const;
+
+private:
+    std::vector<float> frame_ms;
+    size_t peak_texture_bytes = 0;
+    long peak_rss_kb = 0;
+    std::vector<benchCapture> captures;
+};
+
+//The command line of djinn_bench: [--script file] [--frames N] [--out file] [--golden dir [--update-golden]]
+struct benchOptions {
+    std::string script_path = "../bench/default.bench";
+    std::string output_path = "bench_results.json";
+    int frames = 0;                 //overrides the frames of the script
+    std::string golden_directory;   //the capture frames are compared with the hashes in it, if given
+    bool update_golden = false;     //writes the hashes (and images) of the capture frames instead
+
+    //Takes argv[i] (and its value) when it is one of the options above, false for the others
+    bool parse(int argc, char** argv, int& i);
+};
+
+/**
+* The frames of djinn_bench. Every frame of the script presses its keys (pressKey, the keys of the
+* window), moves the camera along its path and calls frame(dt), with dt advancing by fixed_dt. The
+* frame time includes the GPU work (glFinish), the capture frames are read back from the context and
+* compared with (or written to) the golden directory, and the report goes to the output path.
+* Returns false when a golden frame doesn't match. Throws runtime_error for a script that can't be
+* read or a file that can't be written.
+*
+*   bool passed = runBench(options, *camera, *offscreen, simClock.fixed_dt, pressKey, [](float dt) { ... });
+*/
+bool runBench(const benchOptions& options, Camera& camera, OffscreenContext& context, float fixed_dt,
+              const std::function<void(int key)>& pressKey, const std::function<void(float dt)>& frame);
+
+//FNV-1a of the pixels, what the golden files store
+uint64_t hashImage(const std::vector<unsigned char>& pixels);
+//<directory>/frame_<frame>.hash, false when there is none
+bool readGoldenHash(const std::string& directory, int frame, uint64_t& hash);
+//The hash of a new golden frame and its image (frame_<frame>.tga, to look at)
+void writeGoldenFrame(const std::string& directory, int frame, uint64_t hash, const std::vector<unsigned char>& rgba, int width, int height);
+
+#endif //VVR_OGL_LABORATORY_BENCH_H
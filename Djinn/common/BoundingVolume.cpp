@@ -0,0 +1,136 @@
+#include "BoundingVolume.h"
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #define BOUNDS_USE_SSE
+    #include <xmmintrin.h>
+#endif
+
+using namespace glm;
+
+boundingVolume computeBounds(const std::vector<vec3>& vertices) {
+    boundingVolume bounds;
+    if (vertices.empty()) return bounds;
+
+    bounds.box.min = bounds.box.max = vertices[0];
+    size_t i = 0;
+#ifdef BOUNDS_USE_SSE
+    //Four vertices per iteration: three loads of the packed vec3s, shuffled into x, y and z lanes
+    static_assert(sizeof(vec3) == 3 * sizeof(float), "packed vertices");
+    const float* data = &vertices[0].x;
+    __m128 low_x = _mm_set1_ps(vertices[0].x), low_y = _mm_set1_ps(vertices[0].y), low_z = _mm_set1_ps(vertices[0].z);
+    __m128 high_x = low_x, high_y = low_y, high_z = low_z;
+    for (; i + 4 <= vertices.size(); i += 4) {
+        __m128 a = _mm_loadu_ps(data + 3 * i);     //x0 y0 z0 x1
+        __m128 b = _mm_loadu_ps(data + 3 * i + 4); //y1 z1 x2 y2
+        __m128 c = _mm_loadu_ps(data + 3 * i + 8); //z2 x3 y3 z3
+        __m128 zx = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 2, 1));                  //z1 x2 x3 y3
+        __m128 x = _mm_shuffle_ps(a, zx, _MM_SHUFFLE(2, 1, 3, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),   //y0 y0 y1 y1
+                                  _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),   //y2 y2 y3 y3
+                                  _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),   //z0 z0 z1 z1
+                                  _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),   //z2 z2 z3 z3
+                                  _MM_SHUFFLE(2, 0, 2, 0));
+        low_x = _mm_min_ps(low_x, x);
+        low_y = _mm_min_ps(low_y, y);
+        low_z = _mm_min_ps(low_z, z);
+        high_x = _mm_max_ps(high_x, x);
+        high_y = _mm_max_ps(high_y, y);
+        high_z = _mm_max_ps(high_z, z);
+    }
+    float lx[4], ly[4], lz[4], hx[4], hy[4], hz[4];
+    _mm_storeu_ps(lx, low_x);
+    _mm_storeu_ps(ly, low_y);
+    _mm_storeu_ps(lz, low_z);
+    _mm_storeu_ps(hx, high_x);
+    _mm_storeu_ps(hy, high_y);
+    _mm_storeu_ps(hz, high_z);
+    for (int lane = 0; lane < 4; lane++) {
+        bounds.box.min = min(bounds.box.min, vec3(lx[lane], ly[lane], lz[lane]));
+        bounds.box.max = max(bounds.box.max, vec3(hx[lane], hy[lane], hz[lane]));
+    }
+#endif // BOUNDS_USE_SSE
+    //The vertices that are left after the groups of four (all of them without SSE)
+    for (; i < vertices.size(); i++) {
+        bounds.box.min = min(bounds.box.min, vertices[i]);
+        bounds.box.max = max(bounds.box.max, vertices[i]);
+    }
+
+    //Around the center of the box, not the smallest sphere but a close one for a single pass
+    bounds.sphere.center = 0.5f * (bounds.box.min + bounds.box.max);
+    float radius_sq = 0.0f;
+    for (const vec3& v : vertices) {
+        vec3 d = v - bounds.sphere.center;
+        radius_sq = std::max(radius_sq, dot(d, d));
+    }
+    bounds.sphere.radius = sqrt(radius_sq);
+    return bounds;
+}
+
+boundingVolume transformBounds(const boundingVolume& bounds, const mat4& modelMatrix) {
+    boundingVolume result;
+
+    vec3 center = 0.5f * (bounds.box.min + bounds.box.max);
+    vec3 extent = 0.5f * (bounds.box.max - bounds.box.min);
+    vec3 new_center = vec3(modelMatrix * vec4(center, 1.0f));
+    vec3 new_extent(0.0f);
+    for (int column = 0; column < 3; column++) {
+        new_extent += abs(vec3(modelMatrix[column])) * extent[column];
+    }
+    result.box.min = new_center - new_extent;
+    result.box.max = new_center + new_extent;
+
+    float scale = std::max(length(vec3(modelMatrix[0])), std::max(length(vec3(modelMatrix[1])), length(vec3(modelMatrix[2]))));
+    result.sphere.center = vec3(modelMatrix * vec4(bounds.sphere.center, 1.0f));
+    result.sphere.radius = bounds.sphere.radius * scale;
+    return result;
+}
+
+boundingVolume mergeBounds(const boundingVolume& a, const boundingVolume& b) {
+    boundingVolume result;
+    result.box.min = min(a.box.min, b.box.min);
+    result.box.max = max(a.box.max, b.box.max);
+
+    //Around the center of the merged box, large enough to hold both spheres
+    result.sphere.center = 0.5f * (result.box.min + result.box.max);
+    float ra = length(a.sphere.center - result.sphere.center) + a.sphere.radius;
+    float rb = length(b.sphere.center - result.sphere.center) + b.sphere.radius;
+    result.sphere.radius = std::max(ra, rb);
+    return result;
+}
+
+Frustum::Frustum(const mat4& VP) {
+    //Rows of the matrix, glm is column major
+    vec4 row0(VP[0][0], VP[1][0], VP[2][0], VP[3][0]);
+    vec4 row1(VP[0][1], VP[1][1], VP[2][1], VP[3][1]);
+    vec4 row2(VP[0][2], VP[1][2], VP[2][2], VP[3][2]);
+    vec4 row3(VP[0][3], VP[1][3], VP[2][3], VP[3][3]);
+
+    planes[0] = row3 + row0; //left
+    planes[1] = row3 - row0; //right
+    planes[2] = row3 + row1; //bottom
+    planes[3] = row3 - row1; //top
+    planes[4] = row3 + row2; //near
+    planes[5] = row3 - row2; //far
+
+    for (vec4& p : planes) {
+        p /= length(vec3(p));
+    }
+}
+
+bool Frustum::intersects(const boundingVolume& bounds) const {
+    for (const vec4& p : planes) {
+        vec3 normal(p);
+
+        //Sphere first, most objects that are out are rejected here
+        if (dot(normal, bounds.sphere.center) + p.w < -bounds.sphere.radius) return false;
+
+        //The corner of the box that is furthest along the normal
+        vec3 corner(normal.x >= 0.0f ? bounds.box.max.x : bounds.box.min.x,
+                    normal.y >= 0.0f ? bounds.box.max.y : bounds.box.min.y,
+                    normal.z >= 0.0f ? bounds.box.max.z : bounds.box.min.z);
+        if (dot(normal, corner) + p.w < 0.0f) return false;
+    }
+    return true;
+}
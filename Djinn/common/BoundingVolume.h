@@ -0,0 +1,44 @@
+#ifndef VVR_OGL_LABORATORY_BOUNDINGVOLUME_H
+#define VVR_OGL_LABORATORY_BOUNDINGVOLUME_H
+#include <vector>
+#include <glm/glm.hpp>
+
+struct boundingBox {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+};
+
+struct boundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+//Both volumes of a mesh: the sphere is the cheap test, the box the tight one
+struct boundingVolume {
+    boundingBox box;
+    boundingSphere sphere;
+};
+
+//Bounds of the vertices (SSE min/max when it is available), zero for no vertices
+boundingVolume computeBounds(const std::vector<glm::vec3>& vertices);
+//Bounds of the volume after the model matrix: the box stays axis aligned (Arvo), the sphere
+//grows with the largest scale of the matrix
+boundingVolume transformBounds(const boundingVolume& bounds, const glm::mat4& modelMatrix);
+//Smallest box and a sphere around both
+boundingVolume mergeBounds(const boundingVolume& a, const boundingVolume& b);
+
+//The six planes of a view-projection matrix (Gribb & Hartmann), for perspective and orthographic
+//projections alike. The normals point inside.
+class Frustum {
+public:
+    Frustum() {}
+    Frustum(const glm::mat4& VP);
+
+    //False only when the volume is entirely outside of one plane
+    bool intersects(const boundingVolume& bounds) const;
+
+private:
+    glm::vec4 planes[6];
+};
+
+#endif //VVR_OGL_LABORATORY_BOUNDINGVOLUME_H
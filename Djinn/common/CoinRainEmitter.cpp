@@ -1,46 +1,161 @@
 #include "CoinRainEmitter.h"
 #include <iostream>
 #include <algorithm>
+#include <execution>
 
-CoinRainEmitter::CoinRainEmitter(Drawable *_model, int number) : IntParticleEmitter(_model, number) {}
+CoinRainEmitter::CoinRainEmitter(int number) : IntParticleEmitter(number) {}
 
 void CoinRainEmitter::updateParticles(float time, float dt, glm::vec3 camera_pos) {
 
     float height_threshold = -3.439f;
+    beginUpdate();
+
+    //In case we resized our emitter to a smaller particle number
+    active_particles = std::min(active_particles, number_of_particles);
+    //Every coin that hit the floor in the last step is recycled, also while the rain ramps up
+    spawnParticles(active_particles - (int)alive_list.size());
 
     //This is for the fountain to slowly increase the number of its particles to the max amount
     //instead of shooting all the particles at once
     if (active_particles < number_of_particles) {
         int batch = 50;
-        int limit = std::min(number_of_particles - active_particles, batch) * dt * 0.8f;
-        for (int i = 0; i < limit; i++) {
-            createNewParticle(active_particles);
-            active_particles++;
-        }
-    }
-    else {
-        active_particles = number_of_particles; //In case we resized our ermitter to a smaller particle number
+        //Keep the fraction, otherwise a short step would never spawn anything
+        spawn_accumulator += std::min(number_of_particles - active_particles, batch) * dt * 0.8f;
+        int limit = (int)spawn_accumulator;
+        spawn_accumulator -= limit;
+        active_particles += spawnParticles(limit);
     }
 
-    for(int i = 0; i < active_particles; i++){
+    //Every coin only touches its own attributes and the read only collision mesh,
+    //so the integration and the scene queries run in parallel
+    std::for_each(std::execution::par, alive_list.begin(), alive_list.end(), [&](int i) {
         particleAttributes & particle = p_attributes[i];
 
-        if(particle.life == 0.0f || checkForCollision(particle)){
-            createNewParticle(i);
+        if(checkForCollision(particle)){
+            killParticle(i);
+            return;
+        }
+
+        particle.prev_position = particle.position;
+
+        if (particle.rest_time > 0.0f) {
+            particle.rest_time += dt;
+            if (particle.rest_time > rest_duration) {
+                killParticle(i);
+                return;
+            }
         }
+        else {
+            glm::vec3 new_position = particle.position + particle.velocity*dt + particle.accel*(dt*dt)*0.5f;
+            glm::vec3 new_velocity = particle.velocity + particle.accel*dt;
 
-        particle.rot_angle += 90*dt; 
+            collisionHit hit;
+            if (collision_mesh != nullptr &&
+                collision_mesh->sweepSphere(particle.position, new_position, coin_radius * particle.mass, hit)) {
+                //Stop at the contact, a little off the surface so the next sweep doesn't start inside it
+                new_position = hit.center + hit.normal * 0.001f;
 
-        particle.position = particle.position + particle.velocity*dt + particle.accel*(dt*dt)*0.5f;
-        particle.velocity = particle.velocity + particle.accel*dt;
+                float normal_speed = glm::dot(new_velocity, hit.normal);
+                glm::vec3 normal_velocity = hit.normal * normal_speed;
+                glm::vec3 tangent_velocity = new_velocity - normal_velocity;
+                new_velocity = tangent_velocity * (1.0f - friction) - normal_velocity * restitution;
 
-        auto bill_rot = calculateBillboardRotationMatrix(particle.position, camera_pos);
-        particle.rot_axis = glm::vec3(bill_rot.x, bill_rot.y, bill_rot.z);
-        particle.rot_angle = glm::degrees(bill_rot.w);
+                //A slow hit on a surface that faces up: the coin lies down
+                if (hit.normal.y > 0.7f && -normal_speed * restitution < rest_speed) {
+                    new_velocity = glm::vec3(0.0f);
+                    particle.rest_time = dt;
+                }
+            }
+
+            particle.position = new_position;
+            particle.velocity = new_velocity;
+        }
+    });
+
+    compactAliveList();
+
+    if (use_separation) separateParticles(dt);
+
+    std::for_each(std::execution::par, alive_list.begin(), alive_list.end(), [&](int i) {
+        particleAttributes & particle = p_attributes[i];
+
+        if (use_billboards) {
+            //The shader faces the camera, the angle only spins the coin
+            particle.rot_angle += 90*dt;
+        }
+        else {
+            auto bill_rot = calculateBillboardRotationMatrix(particle.position, camera_pos);
+            particle.rot_axis = glm::vec3(bill_rot.x, bill_rot.y, bill_rot.z);
+            particle.rot_angle = glm::degrees(bill_rot.w);
+        }
         particle.dist_from_camera = length(particle.position - camera_pos);
 
         particle.life = (height_threshold - particle.position.y) / (height_threshold - emitter_pos.y);
-    }
+    });
+}
+
+void CoinRainEmitter::separateParticles(float dt) {
+    int live = alive_list.size();
+    grid_positions.resize(live);
+    separation.resize(live);
+    landed.resize(live);
+
+    std::transform(std::execution::par, alive_list.begin(), alive_list.end(), grid_positions.begin(),
+        [&](int i) { return p_attributes[i].position; });
+
+    //Two coins can only touch if their centers are closer than two of the biggest radius
+    grid.cell_size = 2.0f * coin_radius * max_mass;
+    grid.build(grid_positions);
+
+    //Jacobi style: every coin reads the positions of this step and writes only its own correction,
+    //so the result doesn't depend on the order the coins are processed in. The order of the grid
+    //keeps the neighbors of the previous coin in the cache
+    gridRange coins = grid.particles();
+    std::for_each(std::execution::par, coins.begin(), coins.end(), [&](int k) {
+        glm::vec3 position = grid_positions[k];
+        const particleAttributes & particle = p_attributes[alive_list[k]];
+        separation[k] = glm::vec3(0.0f);
+        landed[k] = false;
+
+        //Coins that lie still are the base of the pile, only the falling ones are pushed out of them
+        if (particle.rest_time > 0.0f) return;
+
+        grid.forEachNeighbor(position, [&](int j) {
+            if (j == k) return;
+            const particleAttributes & other = p_attributes[alive_list[j]];
+
+            glm::vec3 offset = position - grid_positions[j];
+            float min_distance = coin_radius * (particle.mass + other.mass);
+            float distance2 = glm::dot(offset, offset);
+            if (distance2 >= min_distance * min_distance || distance2 == 0.0f) return;
+
+            float distance = sqrt(distance2);
+            glm::vec3 normal = offset / distance;
+            bool other_rests = other.rest_time > 0.0f;
+            //Against a resting coin this one takes the whole correction, otherwise they share it
+            separation[k] += normal * (min_distance - distance) * (other_rests ? 1.0f : 0.5f);
+            if (other_rests && normal.y > 0.7f) landed[k] = true;
+        });
+    });
+
+    std::for_each(std::execution::par, coins.begin(), coins.end(), [&](int k) {
+        particleAttributes & particle = p_attributes[alive_list[k]];
+        if (separation[k] == glm::vec3(0.0f)) return;
+
+        particle.position += separation[k];
+
+        if (landed[k]) {
+            //On top of the pile: it lies still like on any other surface
+            particle.velocity = glm::vec3(0.0f);
+            particle.rest_time = dt;
+        }
+        else {
+            //Remove the velocity that pushes into the other coins
+            glm::vec3 normal = glm::normalize(separation[k]);
+            float normal_speed = glm::dot(particle.velocity, normal);
+            if (normal_speed < 0.0f) particle.velocity -= normal * normal_speed * (1.0f + restitution);
+        }
+    });
 }
 
 bool CoinRainEmitter::checkForCollision(particleAttributes& particle)
@@ -52,12 +167,13 @@ void CoinRainEmitter::createNewParticle(int index)
 {
     particleAttributes & particle = p_attributes[index];
 
-    particle.position = emitter_pos + glm::vec3(3 - RAND*6, -1 * RAND, 3 - RAND*6) * 4.0f;
+    particle.position = emitter_pos + glm::vec3(3 - randomFloat()*6, -1 * randomFloat(), 3 - randomFloat()*6) * 4.0f;
     particle.velocity = glm::vec3(0,-10.0f,0);
 
-    particle.mass = RAND + 0.5f;
-    particle.rot_axis = glm::normalize(glm::vec3(1 - 2*RAND, 1 - 2*RAND, 1 - 2*RAND));
+    particle.mass = randomFloat() + 0.5f;
+    particle.rot_axis = glm::normalize(glm::vec3(1 - 2*randomFloat(), 1 - 2*randomFloat(), 1 - 2*randomFloat()));
     particle.accel = glm::vec3(0.0f, -9.8f, 0.0f); //gravity force
-    particle.rot_angle = RAND*360;
+    particle.rot_angle = randomFloat()*360;
     particle.life = 1.0f; //mark it alive
+    particle.rest_time = 0.0f;
 }
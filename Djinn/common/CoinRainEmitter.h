@@ -1,16 +1,40 @@
 #ifndef VVR_OGL_LABORATORY_RAINEMITTER_H
 #define VVR_OGL_LABORATORY_RAINEMITTER_H
 #include "IntParticleEmitter.h"
+#include "CollisionMesh.h"
+#include "ParticleGrid.h"
 
 class CoinRainEmitter : public IntParticleEmitter {
     public:
-        CoinRainEmitter(Drawable* _model, int number);
+        CoinRainEmitter(int number);
 
+        //Kill plane under the floor, for the coins that leave the scene
         bool checkForCollision(particleAttributes& particle);
 
+        //Static scene the coins bounce on and pile up on (not owned). Without it they only fall to the floor height
+        CollisionMesh* collision_mesh = nullptr;
+        float coin_radius = 0.13f;   //radius of the coin mesh, scaled by the mass of each coin
+        float restitution = 0.4f;    //fraction of the normal speed kept after a bounce
+        float friction = 0.3f;       //fraction of the tangential speed lost in a bounce
+        float rest_speed = 0.5f;     //slower bounces than this make the coin lie still
+        float rest_duration = 3.0f;  //seconds a coin lies on a surface before it is recycled
+
+        //Coins push each other apart and pile up on the ones that already lie still
+        bool use_separation = true;
+        float max_mass = 1.5f;       //biggest mass of createNewParticle, sizes the grid cells
+
         int active_particles = 0; //number of particles that have been instantiated
+        float spawn_accumulator = 0.0f; //fractional coins that are carried over to the next update
         void createNewParticle(int index) override;
         void updateParticles(float time, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) override;
+
+    private:
+        ParticleGrid grid;
+        std::vector<glm::vec3> grid_positions; //positions of the live coins, in the order of alive_list
+        std::vector<glm::vec3> separation;
+        std::vector<char> landed;
+
+        void separateParticles(float dt);
 };
 
 #endif //VVR_OGL_LABORATORY_RAINEMITTER_H
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "CollisionMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cassert>
+#include <numeric>
+#include <execution>
+
+using namespace glm;
+
+//Closest point of the triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+static vec3 closestPointOnTriangle(vec3 p, vec3 a, vec3 b, vec3 c) {
+    vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    vec3 bp = p - b;
+    float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    vec3 cp = p - c;
+    float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//Entry fraction of the segment from + t*motion (t in [0, 1]) into the box, or a value > 1 if it misses
+static float segmentBoxEntry(vec3 from, vec3 inv_motion, vec3 box_min, vec3 box_max) {
+    vec3 t0 = (box_min - from) * inv_motion;
+    vec3 t1 = (box_max - from) * inv_motion;
+    vec3 t_near = min(t0, t1), t_far = max(t0, t1);
+    float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+    float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, 1.0f));
+    return t_enter <= t_exit ? t_enter : 2.0f;
+}
+
+void CollisionMesh::addTriangles(const std::vector<vec3>& vertices, const std::vector<unsigned int>& indices,
+                                 const mat4& modelMatrix) {
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        triangle tri;
+        tri.a = vec3(modelMatrix * vec4(vertices[indices[i]], 1.0f));
+        tri.b = vec3(modelMatrix * vec4(vertices[indices[i + 1]], 1.0f));
+        tri.c = vec3(modelMatrix * vec4(vertices[indices[i + 2]], 1.0f));
+
+        vec3 n = cross(tri.b - tri.a, tri.c - tri.a);
+        if (dot(n, n) < 1e-12f) continue; //degenerate, can't be hit
+        tri.normal = normalize(n);
+        triangles.push_back(tri);
+    }
+}
+
+void CollisionMesh::build() {
+    nodes.clear();
+    tree_depth = 0;
+    if (triangles.empty()) return;
+
+    nodes.reserve(2 * triangles.size() / leaf_size + 1);
+    bvhNode root;
+    root.first = 0;
+    root.count = triangles.size();
+    nodes.push_back(root);
+    subdivide(0, 0);
+}
+
+void CollisionMesh::subdivide(int node_index, int depth) {
+    tree_depth = std::max(tree_depth, depth);
+    int first = nodes[node_index].first;
+    int count = nodes[node_index].count;
+
+    vec3 box_min(FLT_MAX), box_max(-FLT_MAX);
+    vec3 centroid_min(FLT_MAX), centroid_max(-FLT_MAX);
+    for (int i = first; i < first + count; i++) {
+        const triangle& tri = triangles[i];
+        box_min = min(box_min, min(tri.a, min(tri.b, tri.c)));
+        box_max = max(box_max, max(tri.a, max(tri.b, tri.c)));
+        vec3 centroid = (tri.a + tri.b + tri.c) / 3.0f;
+        centroid_min = min(centroid_min, centroid);
+        centroid_max = max(centroid_max, centroid);
+    }
+    nodes[node_index].box_min = box_min;
+    nodes[node_index].box_max = box_max;
+
+    if (count <= leaf_size) return;
+
+    //Split the longest axis of the centroids in the middle
+    vec3 extent = centroid_max - centroid_min;
+    int axis = 0;
+    if (extent.y > extent.x) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+    float split = centroid_min[axis] + extent[axis] * 0.5f;
+
+    auto begin = triangles.begin() + first;
+    auto end = begin + count;
+    auto middle = std::partition(begin, end, [=](const triangle& tri) {
+        return (tri.a[axis] + tri.b[axis] + tri.c[axis]) / 3.0f < split;
+    });
+    int left_count = middle - begin;
+
+    //All the centroids on one side (e.g. coplanar strips): fall back to a median split
+    if (left_count == 0 || left_count == count) {
+        left_count = count / 2;
+        std::nth_element(begin, begin + left_count, end, [=](const triangle& l, const triangle& r) {
+            return l.a[axis] + l.b[axis] + l.c[axis] < r.a[axis] + r.b[axis] + r.c[axis];
+        });
+    }
+
+    int left_index = nodes.size();
+    bvhNode left, right;
+    left.first = first;
+    left.count = left_count;
+    right.first = first + left_count;
+    right.count = count - left_count;
+    nodes.push_back(left);
+    nodes.push_back(right);
+
+    nodes[node_index].first = left_index;
+    nodes[node_index].count = 0;
+
+    subdivide(left_index, depth + 1);
+    subdivide(left_index + 1, depth + 1);
+}
+
+bool CollisionMesh::sweepTriangle(const triangle& tri, vec3 from, vec3 motion, float radius, collisionHit& hit) const {
+    vec3 n = tri.normal;
+    float d0 = dot(from - tri.a, n);
+    float d1 = d0 + dot(motion, n);
+
+    //The triangles are two sided, use the side the sphere starts on
+    if (d0 < 0.0f) {
+        n = -n;
+        d0 = -d0;
+        d1 = -d1;
+    }
+    if (d1 >= d0 || d1 >= radius) return false; //moving away, or never close enough to the plane
+
+    float t = d0 <= radius ? 0.0f : (d0 - radius) / (d0 - d1);
+    if (t >= hit.t) return false;
+
+    //Where the sphere touches the plane has to lie on the triangle. Contacts on the edges
+    //are accepted if they are within the radius of the triangle
+    vec3 center = from + motion * t;
+    vec3 on_plane = center - n * std::min(d0, radius);
+    vec3 closest = closestPointOnTriangle(on_plane, tri.a, tri.b, tri.c);
+    vec3 offset = on_plane - closest;
+    if (dot(offset, offset) > radius * radius) return false;
+
+    hit.t = t;
+    hit.center = center;
+    hit.normal = n;
+    return true;
+}
+
+bool CollisionMesh::sweepSphere(vec3 from, vec3 to, float radius, collisionHit& hit) const {
+    hit.t = 1.0f;
+    if (nodes.empty()) return false;
+
+    vec3 motion = to - from;
+    if (motion == vec3(0.0f)) return false; //a resting sphere can't start a new contact
+
+    //An axis without motion gets a huge inverse instead of inf, so 0 * inf never makes a NaN
+    vec3 inv_motion;
+    for (int k = 0; k < 3; k++) {
+        inv_motion[k] = 1.0f / (std::abs(motion[k]) > 1e-12f ? motion[k] : 1e-12f);
+    }
+    vec3 inflate(radius);
+    bool found = false;
+
+    //Every level leaves at most one sibling on the stack. The splits in the middle keep the trees
+    //of the scene far below 64 levels, a degenerate one gets a stack from the heap
+    int local_stack[64];
+    std::vector<int> heap_stack;
+    int* stack = local_stack;
+    int stack_size = tree_depth + 2;
+    if (stack_size > 64) {
+        heap_stack.resize(stack_size);
+        stack = heap_stack.data();
+    }
+
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const bvhNode& node = nodes[stack[--top]];
+        if (segmentBoxEntry(from, inv_motion, node.box_min - inflate, node.box_max + inflate) > hit.t) continue;
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                found |= sweepTriangle(triangles[i], from, motion, radius, hit);
+            }
+        }
+        else {
+            assert(top + 2 <= stack_size);
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        }
+    }
+    return found;
+}
+
+void CollisionMesh::sweepSpheres(const std::vector<vec3>& from, const std::vector<vec3>& to,
+                                 const std::vector<float>& radius, std::vector<collisionHit>& hits) const {
+    hits.resize(from.size());
+    //Parallel algorithms may hand out copies of the elements, so the loop runs over the indices
+    std::vector<int> particles(from.size());
+    std::iota(particles.begin(), particles.end(), 0);
+    std::for_each(std::execution::par, particles.begin(), particles.end(), [&](int i) {
+        sweepSphere(from[i], to[i], radius[i], hits[i]);
+    });
+}
@@ -0,0 +1,72 @@
+#ifndef VVR_OGL_LABORATORY_COLLISIONMESH_H
+#define VVR_OGL_LABORATORY_COLLISIONMESH_H
+#include <vector>
+#include <glm/glm.hpp>
+
+//Result of a swept sphere query
+struct collisionHit {
+    float t = 1.0f;           //fraction of the sweep where the sphere touches the surface
+    glm::vec3 center;         //center of the sphere at the moment of contact
+    glm::vec3 normal;         //surface normal, facing the side the sphere came from
+};
+
+/**
+* Static triangle soup of the scene, in world space, with a bounding volume hierarchy over it.
+* It is built once from the indexed triangles of the static Drawables and never touches GL,
+* so it can be queried from the parallel particle updates.
+*
+*   mesh.addDrawable(*table, tableModelMatrix);
+*   mesh.build();
+*   if (mesh.sweepSphere(old_pos, new_pos, radius, hit)) ...
+*/
+class CollisionMesh {
+public:
+    //Triangles in a BVH leaf
+    int leaf_size = 4;
+
+    //Any mesh with indexedVertices and indices (Drawable, ogl::Mesh), without depending on GL
+    template<typename Mesh>
+    void addDrawable(const Mesh& drawable, const glm::mat4& modelMatrix) {
+        addTriangles(drawable.indexedVertices, drawable.indices, modelMatrix);
+    }
+    void addTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices,
+                      const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+    //Builds the hierarchy, call it after the last addDrawable
+    void build();
+
+    //First contact of a sphere moving from -> to. Returns false if the path is free
+    bool sweepSphere(glm::vec3 from, glm::vec3 to, float radius, collisionHit& hit) const;
+
+    //Runs sweepSphere for every particle in parallel, hits[i].t == 1 means no contact
+    void sweepSpheres(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to,
+                      const std::vector<float>& radius, std::vector<collisionHit>& hits) const;
+
+    int triangleCount() const { return triangles.size(); }
+    int nodeCount() const { return nodes.size(); }
+    //Levels below the root, the traversal stack of sweepSphere needs depth() + 1 entries
+    int depth() const { return tree_depth; }
+
+private:
+    struct triangle {
+        glm::vec3 a, b, c;
+        glm::vec3 normal;
+    };
+
+    //Inner nodes store the index of their left child (the right one follows it),
+    //leaves store the range [first, first + count) of their triangles
+    struct bvhNode {
+        glm::vec3 box_min, box_max;
+        int first = 0;
+        int count = 0; //0 for an inner node
+    };
+
+    std::vector<triangle> triangles;
+    std::vector<bvhNode> nodes;
+    int tree_depth = 0;
+
+    void subdivide(int node_index, int depth);
+    bool sweepTriangle(const triangle& tri, glm::vec3 from, glm::vec3 motion, float radius, collisionHit& hit) const;
+};
+
+#endif //VVR_OGL_LABORATORY_COLLISIONMESH_H
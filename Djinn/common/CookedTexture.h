@@ -0,0 +1,63 @@
+#ifndef VVR_OGL_LABORATORY_COOKEDTEXTURE_H
+#define VVR_OGL_LABORATORY_COOKEDTEXTURE_H
+#include <cstdint>
+#include <cstddef>
+
+//Layout of the .dtex files written by texcook and read by loadCookedTexture:
+//a cookedTextureHeader, mip_count cookedMip entries and the blocks of every mip, level 0 first.
+//Everything is little endian, offsets are from the start of the file.
+
+#define COOKED_TEXTURE_MAGIC 0x58544a44 // "DJTX"
+#define COOKED_TEXTURE_VERSION 1
+
+//Block compression of the mips, 4x4 texels per block
+enum cookedFormat : uint32_t {
+    COOKED_BC1 = 1, //RGB, 8 bytes per block
+    COOKED_BC3 = 3, //RGBA, 16 bytes per block
+    COOKED_BC5 = 5  //two channels (normal maps: x, y), 16 bytes per block
+};
+
+struct cookedTextureHeader {
+    uint32_t magic = COOKED_TEXTURE_MAGIC;
+    uint32_t version = COOKED_TEXTURE_VERSION;
+    uint32_t format = COOKED_BC1;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mip_count = 0;
+};
+
+struct cookedMip {
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;
+    uint32_t size;
+};
+
+inline uint32_t cookedBlockBytes(uint32_t format) {
+    return format == COOKED_BC1 ? 8 : 16;
+}
+
+inline uint32_t cookedMipSize(uint32_t format, uint32_t width, uint32_t height) {
+    return ((width + 3) / 4) * ((height + 3) / 4) * cookedBlockBytes(format);
+}
+
+//The header of a mapped file, null when it isn't a cooked texture of this version or is truncated
+inline const cookedTextureHeader* cookedHeader(const unsigned char* data, size_t size) {
+    const cookedTextureHeader* header = (const cookedTextureHeader*) data;
+    if (!data || size < sizeof(cookedTextureHeader) || header->magic != COOKED_TEXTURE_MAGIC ||
+        header->version != COOKED_TEXTURE_VERSION || header->mip_count == 0 ||
+        size < sizeof(cookedTextureHeader) + header->mip_count * sizeof(cookedMip)) {
+        return nullptr;
+    }
+    const cookedMip* mips = (const cookedMip*) (data + sizeof(cookedTextureHeader));
+    for (uint32_t level = 0; level < header->mip_count; level++) {
+        if (mips[level].offset + (size_t) mips[level].size > size) return nullptr;
+    }
+    return header;
+}
+
+inline const cookedMip* cookedMips(const unsigned char* data) {
+    return (const cookedMip*) (data + sizeof(cookedTextureHeader));
+}
+
+#endif //VVR_OGL_LABORATORY_COOKEDTEXTURE_H
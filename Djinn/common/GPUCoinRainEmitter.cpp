@@ -0,0 +1,53 @@
+#include "GPUCoinRainEmitter.h"
+#include <algorithm>
+
+// The base class owns the CPU side arrays, so it is created empty.
+// All the particle state is kept in the state buffers of GPUCoinRainRenderer instead.
+GPUCoinRainEmitter::GPUCoinRainEmitter(int number) : IntParticleEmitter(0) {
+    number_of_particles = number;
+    use_sorting = false; // the GPU state is never read back, so it can't be sorted on the CPU
+}
+
+void GPUCoinRainEmitter::updateParticles(float time, float dt, glm::vec3 camera_pos) {
+    //Same ramp up as the CPU emitter, the new particles are spawned by the update shader
+    int first_new_particle = active_particles;
+    if (active_particles < number_of_particles) {
+        int batch = 50;
+        spawn_accumulator += std::min(number_of_particles - active_particles, batch) * dt * 0.8f;
+        int limit = (int)spawn_accumulator;
+        spawn_accumulator -= limit;
+        active_particles += limit;
+    }
+    else {
+        active_particles = number_of_particles;
+    }
+
+    //The GPU respawns dead coins in place, the renderer reads back how many
+    stats.spawned = active_particles - first_new_particle + gpu_respawns;
+    stats.killed = gpu_respawns;
+    stats.live = active_particles;
+    gpu_respawns = 0;
+
+    //No GL calls here, the step is executed by the renderer
+    pending_steps.push_back({ dt, hash_seed + frame++, first_new_particle, active_particles });
+}
+
+void GPUCoinRainEmitter::seed(unsigned int s) {
+    hash_seed = s;
+    frame = 0;
+}
+
+void GPUCoinRainEmitter::createNewParticle(int index) {
+    // Particles are respawned inside coinRainUpdate.vertexshader
+}
+
+void GPUCoinRainEmitter::changeParticleNumber(int new_number) {
+    if (new_number == number_of_particles) return;
+
+    number_of_particles = new_number;
+    active_particles = std::min(active_particles, number_of_particles);
+    for (auto& step : pending_steps) {
+        step.active_particles = std::min(step.active_particles, number_of_particles);
+        step.first_new_particle = std::min(step.first_new_particle, step.active_particles);
+    }
+}
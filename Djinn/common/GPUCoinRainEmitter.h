@@ -0,0 +1,39 @@
+#ifndef VVR_OGL_LABORATORY_GPUCOINRAINEMITTER_H
+#define VVR_OGL_LABORATORY_GPUCOINRAINEMITTER_H
+#include "IntParticleEmitter.h"
+
+// Same ballistic motion as CoinRainEmitter, but the particle state lives on the GPU and every step
+// is a transform feedback pass (see GPUCoinRainRenderer). This class only does the bookkeeping:
+// the ramp up and the list of steps that the renderer has to run.
+// CoinRainEmitter stays as the CPU reference implementation.
+class GPUCoinRainEmitter : public IntParticleEmitter {
+    public:
+        GPUCoinRainEmitter(int number);
+
+        int active_particles = 0; //number of particles that have been instantiated
+        unsigned int hash_seed = 1; //seed of the hash that respawns the particles on the GPU
+        float spawn_accumulator = 0.0f; //fractional coins that are carried over to the next update
+        //Coins that the update passes respawned, added by GPUCoinRainRenderer::readRespawns a frame
+        //or two after they happened and reported as killed (and spawned) by the next update
+        int gpu_respawns = 0;
+
+        // Steps recorded by updateParticles and executed by the next render,
+        // one transform feedback pass each so that fixed steps integrate the same as on the CPU
+        struct pendingStep {
+            float dt;
+            unsigned int seed;
+            int first_new_particle;
+            int active_particles;
+        };
+        std::vector<pendingStep> pending_steps;
+
+        void createNewParticle(int index) override;
+        void updateParticles(float time, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) override;
+        void changeParticleNumber(int new_number) override;
+        void seed(unsigned int s) override;
+
+    private:
+        unsigned int frame = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_GPUCOINRAINEMITTER_H
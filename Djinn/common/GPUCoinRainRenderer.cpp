@@ -0,0 +1,230 @@
+#include "GPUCoinRainRenderer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstddef>
+
+GPUCoinRainRenderer::GPUCoinRainRenderer(Drawable *_model, GLuint _update_program)
+    : ParticleRenderer(_model, false), update_program(_update_program) {
+    dtLocation = glGetUniformLocation(update_program, "dt");
+    seedLocation = glGetUniformLocation(update_program, "seed");
+    emitterPosLocation = glGetUniformLocation(update_program, "emitter_pos");
+    firstNewLocation = glGetUniformLocation(update_program, "first_new_particle");
+
+    glGenVertexArrays(2, update_VAOs);
+    glGenVertexArrays(2, render_VAOs);
+    state_buffers[0] = state_buffers[1] = 0;
+}
+
+GPUCoinRainRenderer::~GPUCoinRainRenderer() {
+    if (readback_fence != 0) glDeleteSync(readback_fence);
+    glDeleteBuffers(1, &readback_buffer);
+    glDeleteBuffers(2, state_buffers);
+    glDeleteVertexArrays(2, update_VAOs);
+    glDeleteVertexArrays(2, render_VAOs);
+}
+
+void GPUCoinRainRenderer::reset() {
+    // The next emitter starts from zero particles, nothing has to be kept
+    allocated_particles = -1;
+    if (readback_fence != 0) glDeleteSync(readback_fence);
+    readback_fence = 0;
+    last_respawns.clear();
+}
+
+void GPUCoinRainRenderer::simulateStep(const GPUCoinRainEmitter& emitter, const GPUCoinRainEmitter::pendingStep& step) {
+    if (step.active_particles == 0) return;
+
+    glUniform1f(dtLocation, step.dt);
+    glUniform1ui(seedLocation, step.seed);
+    glUniform3f(emitterPosLocation, emitter.emitter_pos.x, emitter.emitter_pos.y, emitter.emitter_pos.z);
+    glUniform1i(firstNewLocation, step.first_new_particle);
+
+    //Read from the current buffer and capture into the other one, nothing is rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(update_VAOs[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, state_buffers[1 - current]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, step.active_particles);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    current = 1 - current;
+}
+
+void GPUCoinRainRenderer::simulate(GPUCoinRainEmitter& emitter) {
+    // Resized by the particle budget (or replaced): keep the particles that are already falling
+    if (emitter.number_of_particles != allocated_particles) {
+        allocateStateBuffers(std::max(allocated_particles, 0), emitter.number_of_particles);
+    }
+    if (allocated_particles == 0 || emitter.pending_steps.empty()) return;
+
+    ProfileScope scope("update");
+    GLint bound_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &bound_program);
+    glUseProgram(update_program);
+    for (const auto& step : emitter.pending_steps) {
+        simulateStep(emitter, step);
+    }
+    emitter.pending_steps.clear();
+    glUseProgram(bound_program);
+
+    requestReadback(emitter.active_particles);
+}
+
+void GPUCoinRainRenderer::requestReadback(int active_particles) {
+    // One copy in flight at a time, the respawn counters add up until the next one
+    if (readback_fence != 0 || active_particles == 0) return;
+
+    if (readback_buffer == 0) glGenBuffers(1, &readback_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer);
+    if (active_particles > readback_capacity) {
+        glBufferData(GL_COPY_WRITE_BUFFER, active_particles * sizeof(gpuParticle), NULL, GL_STREAM_READ);
+        readback_capacity = active_particles;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, state_buffers[current]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, active_particles * sizeof(gpuParticle));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback_particles = active_particles;
+}
+
+void GPUCoinRainRenderer::readRespawns(GPUCoinRainEmitter& emitter, bool wait) {
+    if (readback_fence == 0) return;
+    GLenum status = glClientWaitSync(readback_fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+    glDeleteSync(readback_fence);
+    readback_fence = 0;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, readback_buffer);
+    const gpuParticle* particles = (const gpuParticle*) glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+        readback_particles * sizeof(gpuParticle), GL_MAP_READ_BIT);
+    if (particles != nullptr) {
+        // The counter of a slot that was activated again starts over, it only counts from there
+        last_respawns.resize(readback_particles, 0.0f);
+        for (int i = 0; i < readback_particles; i++) {
+            if (particles[i].respawns > last_respawns[i]) emitter.gpu_respawns += (int) (particles[i].respawns - last_respawns[i]);
+            last_respawns[i] = particles[i].respawns;
+        }
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+std::vector<gpuParticle> GPUCoinRainRenderer::readState(int count) const {
+    std::vector<gpuParticle> particles(std::max(0, std::min(count, allocated_particles)));
+    if (particles.empty()) return particles;
+    glBindBuffer(GL_COPY_READ_BUFFER, state_buffers[current]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, particles.size() * sizeof(gpuParticle), particles.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return particles;
+}
+
+void GPUCoinRainRenderer::render(IntParticleEmitter& emitter) {
+    GPUCoinRainEmitter* gpu_emitter = dynamic_cast<GPUCoinRainEmitter*>(&emitter);
+    if (gpu_emitter == nullptr) return;
+
+    readRespawns(*gpu_emitter);
+    simulate(*gpu_emitter);
+    if (gpu_emitter->active_particles == 0 || model == nullptr) return;
+
+    //The instance attributes are read straight from the state buffer that the update pass wrote
+    glBindVertexArray(render_VAOs[current]);
+    glDrawElementsInstanced(GL_TRIANGLES, 3 * model->indices.size(), GL_UNSIGNED_INT, 0, gpu_emitter->active_particles);
+}
+
+void GPUCoinRainRenderer::allocateStateBuffers(int old_number, int new_number) {
+    // The slots above new_number start over when they are activated again
+    if (last_respawns.size() > new_number) last_respawns.resize(new_number);
+    allocated_particles = new_number;
+
+    // The particle budget moves the number by a few percent a frame. The buffers grow to at least
+    // twice their size and never shrink, so those changes don't create and copy new buffers
+    if (new_number <= capacity) return;
+    int new_capacity = std::max(new_number, 2 * capacity);
+
+    GLuint new_buffers[2];
+    glGenBuffers(2, new_buffers);
+
+    // The contents don't need to be initialized, the slots above active_particles
+    // are respawned by the update shader the first time they are used
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, new_buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, std::max(new_capacity, 1) * sizeof(gpuParticle), NULL, GL_DYNAMIC_COPY);
+    }
+
+    // Keep the particles that are already falling when the emitter grows
+    int kept = std::min(old_number, new_number);
+    if (kept > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, state_buffers[current]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffers[0]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, kept * sizeof(gpuParticle));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (state_buffers[0] != 0) glDeleteBuffers(2, state_buffers);
+    state_buffers[0] = new_buffers[0];
+    state_buffers[1] = new_buffers[1];
+    current = 0;
+    capacity = new_capacity;
+
+    configureStateVAOs();
+}
+
+void GPUCoinRainRenderer::configureStateVAOs() {
+    GLsizei stride = sizeof(gpuParticle);
+
+    for (int i = 0; i < 2; i++) {
+        //Update VAO: one vertex per particle
+        glBindVertexArray(update_VAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, state_buffers[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, mass));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, velocity));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, life));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, respawns));
+
+        if (model == nullptr) continue;
+
+        //Render VAO: the coin mesh plus the state buffer as per instance data
+        glBindVertexArray(render_VAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, model->verticesVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(0);
+
+        if (model->indexedNormals.size() != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, model->normalsVBO);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(1);
+        }
+
+        if (model->indexedUVS.size() != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, model->uvsVBO);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(2);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->elementVBO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, state_buffers[i]);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, position));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(11);
+        glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, mass));
+        glVertexAttribDivisor(11, 1);
+        glEnableVertexAttribArray(12);
+        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(gpuParticle, life));
+        glVertexAttribDivisor(12, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,59 @@
+#ifndef VVR_OGL_LABORATORY_GPUCOINRAINRENDERER_H
+#define VVR_OGL_LABORATORY_GPUCOINRAINRENDERER_H
+#include "ParticleRenderer.h"
+#include "GPUCoinRainEmitter.h"
+
+// Layout of one particle inside the GPU state buffers (must match coinRainUpdate.vertexshader)
+struct gpuParticle {
+    glm::vec3 position;
+    float mass;
+    glm::vec3 velocity;
+    float life;
+    float respawns; //deaths of the coins in this slot, for the statistics of the emitter
+};
+
+// Holds the state of a GPUCoinRainEmitter in two GPU buffers. Every pending step of the emitter
+// is a transform feedback pass from one buffer to the other, then the latest buffer is drawn
+// as the per instance data. Only draws GPUCoinRainEmitters.
+// Without a model it only simulates (the test of the two backends).
+class GPUCoinRainRenderer : public ParticleRenderer {
+    public:
+        GPUCoinRainRenderer(Drawable* _model, GLuint _update_program);
+        ~GPUCoinRainRenderer();
+
+        // Runs the pending simulation steps and draws the result with the currently bound program
+        void render(IntParticleEmitter& emitter) override;
+        void reset() override;
+
+        // Runs the pending steps of the emitter, render calls it before drawing
+        void simulate(GPUCoinRainEmitter& emitter);
+        // Adds the respawns of the update passes to emitter.gpu_respawns. The state is copied after
+        // the steps of a frame and read once the GPU is done with it, or right away with wait
+        void readRespawns(GPUCoinRainEmitter& emitter, bool wait = false);
+        // The state of the first count particles, waits for the GPU
+        std::vector<gpuParticle> readState(int count) const;
+
+    private:
+        GLuint update_program;
+        GLuint state_buffers[2];
+        GLuint update_VAOs[2];
+        GLuint render_VAOs[2];
+        int current = 0; //the buffer that holds the latest state
+        int allocated_particles = -1; //particles of the emitter the state is kept for, -1 before the first render
+        int capacity = 0; //particles the state buffers have room for, they only grow
+
+        // Copy of the state for readRespawns, in flight until the fence is signaled
+        GLuint readback_buffer = 0;
+        GLsync readback_fence = 0;
+        int readback_particles = 0, readback_capacity = 0;
+        std::vector<float> last_respawns; //respawns of every slot at the last read
+
+        GLuint dtLocation, seedLocation, emitterPosLocation, firstNewLocation;
+
+        void allocateStateBuffers(int old_number, int new_number);
+        void configureStateVAOs();
+        void simulateStep(const GPUCoinRainEmitter& emitter, const GPUCoinRainEmitter::pendingStep& step);
+        void requestReadback(int active_particles);
+};
+
+#endif //VVR_OGL_LABORATORY_GPUCOINRAINRENDERER_H
@@ -0,0 +1,190 @@
+#include "InstancedDrawable.h"
+#include <algorithm>
+#include <stdexcept>
+
+InstancedDrawable::InstancedDrawable(Drawable* model) : mesh_bounds(model->bounds), index_count(model->indices.size()) {
+    configureVAO(model->verticesVBO,
+                 model->indexedNormals.size() != 0 ? model->normalsVBO : 0,
+                 model->indexedUVS.size() != 0 ? model->uvsVBO : 0,
+                 model->elementVBO);
+}
+
+InstancedDrawable::InstancedDrawable(ogl::Mesh* mesh) : mesh_bounds(mesh->bounds), index_count(mesh->indices.size()) {
+    configureVAO(mesh->verticesVBO,
+                 mesh->indexedNormals.size() != 0 ? mesh->normalsVBO : 0,
+                 mesh->indexedUVS.size() != 0 ? mesh->uvsVBO : 0,
+                 mesh->elementVBO);
+}
+
+InstancedDrawable::~InstancedDrawable() {
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void InstancedDrawable::configureVAO(GLuint vertices, GLuint normals, GLuint uvs, GLuint elements) {
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    //The mesh's buffers are already on the GPU, only the attributes are configured again
+    glBindBuffer(GL_ARRAY_BUFFER, vertices);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    if (normals != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, normals);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(1);
+    }
+
+    if (uvs != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, uvs);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(2);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+
+    //One mat4 per instance, as 4 vec4 attributes
+    glGenBuffers(1, &instanceVBO);
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribDivisor(3 + i, 1);
+    }
+    pointAttributes(0);
+
+    glBindVertexArray(0);
+}
+
+void InstancedDrawable::pointAttributes(int first) {
+    if (first == attribute_offset) return;
+
+    //Expects the VAO to be bound
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    std::size_t vec4Size = sizeof(glm::vec4);
+    std::size_t base = first * sizeof(glm::mat4);
+    for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(base + i * vec4Size));
+    }
+    attribute_offset = first;
+}
+
+int InstancedDrawable::addInstance(const glm::mat4& transform, int material) {
+    int id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    else {
+        id = slots.size();
+        slots.push_back(-1);
+    }
+    slots[id] = instances.size();
+    instances.push_back({ transform, material, id });
+    dirty = true;
+    changes++;
+    return id;
+}
+
+void InstancedDrawable::removeInstance(int id) {
+    if (id < 0 || id >= slots.size() || slots[id] < 0) {
+        throw std::runtime_error("Removing an instance that doesn't exist");
+    }
+    int slot = slots[id];
+    instances[slot] = instances.back();
+    slots[instances[slot].id] = slot;
+    instances.pop_back();
+
+    slots[id] = -1;
+    free_ids.push_back(id);
+    dirty = true;
+    changes++;
+}
+
+void InstancedDrawable::updateInstance(int id, const glm::mat4& transform) {
+    instances[slots[id]].transform = transform;
+    dirty = true;
+    changes++;
+}
+
+void InstancedDrawable::updateInstance(int id, const glm::mat4& transform, int material) {
+    instance& i = instances[slots[id]];
+    i.transform = transform;
+    i.material = material;
+    dirty = true;
+    changes++;
+}
+
+void InstancedDrawable::clear() {
+    instances.clear();
+    slots.clear();
+    free_ids.clear();
+    dirty = true;
+    changes++;
+}
+
+int InstancedDrawable::instanceCount(int material) const {
+    if (material < 0) return instances.size();
+    for (const instanceGroup& g : groups) {
+        if (g.material == material) return g.count;
+    }
+    return 0;
+}
+
+const boundingVolume& InstancedDrawable::bounds() {
+    if (bounds_version == changes) return instance_bounds;
+
+    instance_bounds = boundingVolume();
+    for (int i = 0; i < instances.size(); i++) {
+        boundingVolume b = transformBounds(mesh_bounds, instances[i].transform);
+        instance_bounds = i == 0 ? b : mergeBounds(instance_bounds, b);
+    }
+    bounds_version = changes;
+    return instance_bounds;
+}
+
+void InstancedDrawable::upload() {
+    //Grouped by material, so that every material is one range of the buffer
+    std::vector<int> order(instances.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [this](int a, int b) { return instances[a].material < instances[b].material; });
+
+    transforms.resize(instances.size());
+    groups.clear();
+    for (int k = 0; k < order.size(); k++) {
+        const instance& i = instances[order[k]];
+        transforms[k] = i.transform;
+        if (groups.empty() || groups.back().material != i.material) groups.push_back({ i.material, k, 0 });
+        groups.back().count++;
+    }
+
+    GLsizeiptr size = transforms.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (size > instance_capacity) {
+        //Grows to twice the size, adding a few props doesn't reallocate every time
+        instance_capacity = std::max<GLsizeiptr>(2 * size, 64 * sizeof(glm::mat4));
+        glBufferData(GL_ARRAY_BUFFER, instance_capacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (size > 0) glBufferSubData(GL_ARRAY_BUFFER, 0, size, &transforms[0]);
+
+    dirty = false;
+}
+
+void InstancedDrawable::bind() {
+    if (dirty) upload();
+    glBindVertexArray(VAO);
+}
+
+void InstancedDrawable::draw(int material, int mode) {
+    if (material < 0) {
+        if (instances.empty()) return;
+        pointAttributes(0);
+        glDrawElementsInstanced(mode, index_count, GL_UNSIGNED_INT, NULL, instances.size());
+        return;
+    }
+    for (const instanceGroup& g : groups) {
+        if (g.material != material) continue;
+        pointAttributes(g.first);
+        glDrawElementsInstanced(mode, index_count, GL_UNSIGNED_INT, NULL, g.count);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef VVR_OGL_LABORATORY_INSTANCEDDRAWABLE_H
+#define VVR_OGL_LABORATORY_INSTANCEDDRAWABLE_H
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "model.h"
+
+/**
+* Many copies of one mesh (a Drawable or an ogl::Mesh) drawn with glDrawElementsInstanced.
+* It has its own VAO over the buffers of the mesh plus a per instance transform (attributes 3-6,
+* instanceModel in the shaders), so the mesh can still be drawn on its own.
+*
+* Every instance has a material index (a RenderQueue material). The transforms are uploaded
+* grouped by material, and draw(material) draws one group with a single call. GL 3.3 has no
+* base instance, so the group is selected by moving the offset of the instance attributes.
+*
+*   InstancedDrawable pile(coin);
+*   int id = pile.addInstance(transform, coinMaterial);
+*   pile.bind();
+*   pile.draw(coinMaterial);
+*/
+class InstancedDrawable {
+public:
+    InstancedDrawable(Drawable* model);
+    InstancedDrawable(ogl::Mesh* mesh);
+    ~InstancedDrawable();
+
+    //Returns the id of the instance, it stays valid until the instance is removed
+    int addInstance(const glm::mat4& transform, int material = -1);
+    void removeInstance(int id);
+    void updateInstance(int id, const glm::mat4& transform);
+    void updateInstance(int id, const glm::mat4& transform, int material);
+    void clear();
+
+    int instanceCount() const { return instances.size(); }
+    //Instances of one material, all of them for -1
+    int instanceCount(int material) const;
+    //Changes with every add, remove or update, for caches of what was drawn
+    unsigned int version() const { return changes; }
+    //All the instances together, before the model matrix of the draw
+    const boundingVolume& bounds();
+
+    //Uploads the instances if they changed and binds the VAO
+    void bind();
+    //Draws the instances of one material (all of them for -1), bind before calling draw
+    void draw(int material = -1, int mode = GL_TRIANGLES);
+
+    GLuint VAO = 0;
+
+private:
+    struct instance {
+        glm::mat4 transform;
+        int material;
+        int id;
+    };
+    //Instances with the same material, consecutive in the instance buffer
+    struct instanceGroup {
+        int material;
+        int first;
+        int count;
+    };
+
+    std::vector<instance> instances;   //dense, removing moves the last one into the hole
+    std::vector<int> slots;            //id -> index in instances, -1 for removed ids
+    std::vector<int> free_ids;
+    std::vector<instanceGroup> groups;
+    std::vector<glm::mat4> transforms; //upload order
+    bool dirty = true;
+    unsigned int changes = 0;
+
+    boundingVolume mesh_bounds;
+    boundingVolume instance_bounds;
+    unsigned int bounds_version = -1;
+
+    GLuint instanceVBO = 0;
+    GLsizeiptr instance_capacity = 0;
+    GLsizei index_count;
+    int attribute_offset = -1;         //first instance that the attributes point to
+
+    void configureVAO(GLuint vertices, GLuint normals, GLuint uvs, GLuint elements);
+    void upload();
+    void pointAttributes(int first);
+};
+
+#endif //VVR_OGL_LABORATORY_INSTANCEDDRAWABLE_H
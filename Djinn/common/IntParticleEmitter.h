@@ -1,18 +1,13 @@
 #pragma once
-#include <GL/glew.h>
 #include <vector>
+#include <random>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include "model.h"
 #include <glm/gtx/string_cast.hpp>
 
-// #define USE_PARALLEL_TRANSFORM
-
-//Gives a random number between 0 and 1
-#define RAND ((float) rand()) / (float) RAND_MAX
-
 struct particleAttributes{
     glm::vec3 position = glm::vec3(0,0,0);
+    glm::vec3 prev_position = glm::vec3(0,0,0); //position at the previous simulation step
     glm::vec3 rot_axis= glm::vec3(0,1,0);
     float rot_angle = 0.0f; //degrees
     glm::vec3 accel = glm::vec3(0,0,0);
@@ -25,6 +20,7 @@ struct particleAttributes{
     glm::vec3 p2 = glm::vec3(0, 0, 0);
     glm::vec3 p3 = glm::vec3(0, 0, 0);
     std::vector<glm::vec3> control_points;
+    float rest_time = 0.0f; //seconds the particle has been lying still on a surface
 
     float dist_from_camera = 0.0f; //In case you want to do depth sorting
     bool operator < (const particleAttributes & p) const
@@ -33,44 +29,70 @@ struct particleAttributes{
     }
 };
 
-//ParticleEmitterInt is an interface class. Emitter classes must derive from this one and implement the updateParticles method
+//Counters of the last update of an emitter
+struct emitterStats {
+    int live = 0;     //particles in the alive list
+    int spawned = 0;  //particles created during the last update
+    int killed = 0;   //particles that died during the last update
+};
+
+//ParticleEmitterInt is an interface class. Emitter classes must derive from this one and implement the updateParticles method.
+//It only holds the simulation state and doesn't use GL, the particles are drawn by a ParticleRenderer
 class IntParticleEmitter
 {
 public:
-    GLuint emitterVAO;
     int number_of_particles;
 
     std::vector<particleAttributes> p_attributes;
 
+    //Indices (in p_attributes) of the live particles. Only these are updated, sorted, uploaded and drawn
+    std::vector<int> alive_list;
+    //Indices of the dead or never spawned particles, they are recycled by spawnParticles
+    std::vector<int> free_list;
+
+    emitterStats stats;
+
     bool use_rotations = true;
     bool use_sorting = true;
+    //Face the camera in the vertex shader and upload only particleInstance per particle.
+    //Without it the billboard rotation is computed on the CPU and uploaded as instance matrices
+    bool use_billboards = true;
 
 
     glm::vec3 emitter_pos; //the origin of the emitter
 
-    IntParticleEmitter(Drawable* _model, int number);
-	void changeParticleNumber(int new_number);
+    //Where between the previous and the current step the particles are drawn (fixed timestep rendering)
+    float interpolation_alpha = 1.0f;
+
+    //Every emitter has its own generator, so emitters can be updated in parallel and replayed from a seed
+    virtual void seed(unsigned int s);
+    float randomFloat(); //between 0 and 1
+
+    IntParticleEmitter(int number);
+    virtual ~IntParticleEmitter() = default;
+	virtual void changeParticleNumber(int new_number);
 
-	void renderParticles(int time = 0);
 	virtual void updateParticles(float time, float dt, glm::vec3 camera_pos) = 0;
 	virtual void createNewParticle(int index) = 0;
     
     glm::vec4 calculateBillboardRotationMatrix(glm::vec3 particle_pos, glm::vec3 camera_pos);
 
+    //Sorts the alive list back to front by dist_from_camera, for blending
+    void sortAliveList();
 
-private:
+    //Bytes of particle state held by the emitter
+    virtual size_t memoryUsage() const;
 
-    std::vector<glm::mat4> translations;
-    std::vector<glm::mat4> rotations;
-    std::vector<float> scales;
-    std::vector<float> lifes;
 
-    Drawable* model;
-    void configureVAO();
-    void bindAndUpdateBuffers();
-    GLuint transformations_buffer;
-    GLuint rotations_buffer;
-    GLuint scales_buffer;
-    GLuint lifes_buffer;
-};
+protected:
+    std::mt19937 rng;
 
+    //Resets the per frame counters, call it at the start of updateParticles
+    void beginUpdate();
+    //Takes up to count slots from the free list, creates the particles and returns how many were spawned
+    int spawnParticles(int count);
+    //Marks the particle dead, it is moved to the free list by compactAliveList
+    void killParticle(int index);
+    //Removes the dead particles from the alive list, call it at the end of updateParticles
+    void compactAliveList();
+};
@@ -0,0 +1,29 @@
+#ifndef VVR_OGL_LABORATORY_MAPPEDFILE_H
+#define VVR_OGL_LABORATORY_MAPPEDFILE_H
+#include <cstddef>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+
+//A read only view of a whole file (mmap, MapViewOfFile), unmapped when it goes out of scope.
+//data is null and size 0 when the file can't be opened or mapped, or is empty
+class MappedFile {
+public:
+    MappedFile(const char* path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+#endif //VVR_OGL_LABORATORY_MAPPEDFILE_H
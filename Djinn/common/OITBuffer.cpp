@@ -0,0 +1,106 @@
+#include "OITBuffer.h"
+#include <iostream>
+#include <stdexcept>
+
+OITBuffer::OITBuffer(GLuint _composite_program) : composite_program(_composite_program) {
+    accumSamplerLocation = glGetUniformLocation(composite_program, "accumSampler");
+    weightSamplerLocation = glGetUniformLocation(composite_program, "weightSampler");
+
+    glGenFramebuffers(1, &framebuffer);
+    glGenTextures(1, &accumTexture);
+    glGenTextures(1, &weightTexture);
+    glGenRenderbuffers(1, &depthRenderbuffer);
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+OITBuffer::~OITBuffer() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &weightTexture);
+    glDeleteRenderbuffers(1, &depthRenderbuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void OITBuffer::resize(int _width, int _height) {
+    width = _width;
+    height = _height;
+
+    // 16 bit floats: the weights are clamped in the shaders so that the sums don't overflow
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Same format as the default framebuffer's depth, glBlitFramebuffer doesn't convert depth formats
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, draw_buffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        throw std::runtime_error("OIT frame buffer not initialized correctly");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OITBuffer::begin(int _width, int _height) {
+    if (_width != width || _height != height) resize(_width, _height);
+
+    // The transparent surfaces are still hidden by the opaque ones, so they need the scene's depth
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    // The revealage starts at 1 (nothing covers the scene), the sums at 0
+    const GLfloat accum_clear[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const GLfloat weight_clear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accum_clear);
+    glClearBufferfv(GL_COLOR, 1, weight_clear);
+
+    // rgb: additive, alpha: multiplied by (1 - alpha). Depth is tested but not written
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+}
+
+void OITBuffer::composite() {
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glDepthMask(GL_TRUE);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, width, height);
+
+    // The composite shader outputs (average color, 1 - revealage)
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(composite_program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    glUniform1i(accumSamplerLocation, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    glUniform1i(weightSamplerLocation, 1);
+
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
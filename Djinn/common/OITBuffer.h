@@ -0,0 +1,45 @@
+#ifndef VVR_OGL_LABORATORY_OITBUFFER_H
+#define VVR_OGL_LABORATORY_OITBUFFER_H
+#include <GL/glew.h>
+
+/**
+* Weighted blended order independent transparency (McGuire & Bavoil).
+* The transparent surfaces are drawn in any order into two targets:
+*   accumulation: rgb = sum(color * alpha * weight), a = product(1 - alpha) (the revealage)
+*   weights:      r = sum(alpha * weight)
+* and composite() blends their weighted average over the opaque scene, so nothing has to be sorted.
+* Both targets use one blend function, which keeps it inside OpenGL 3.3 (no glBlendFunci).
+*
+*   oit.begin(width, height);
+*   //draw the transparent objects with oit_pass = 1, see writeOIT() in the fragment shaders
+*   oit.composite();
+*/
+class OITBuffer {
+public:
+    //Framebuffer that the scene is drawn into, 0 for the window's. Its depth must be GL_DEPTH24_STENCIL8
+    GLuint target = 0;
+
+    OITBuffer(GLuint _composite_program);
+    ~OITBuffer();
+
+    //Copies the depth of the opaque scene (target), clears the targets and sets the
+    //accumulation blending. The viewport of the scene is kept, so it must fit in width x height
+    void begin(int width, int height);
+    //Blends the transparent layer over the target and restores the blend/depth state
+    void composite();
+
+private:
+    GLuint composite_program;
+    GLuint accumSamplerLocation, weightSamplerLocation;
+
+    GLuint framebuffer = 0;
+    GLuint accumTexture = 0, weightTexture = 0;
+    GLuint depthRenderbuffer = 0;
+    GLuint emptyVAO = 0; //the fullscreen triangle is generated from gl_VertexID
+
+    int width = 0, height = 0;
+
+    void resize(int _width, int _height);
+};
+
+#endif //VVR_OGL_LABORATORY_OITBUFFER_H
@@ -0,0 +1,40 @@
+#ifndef VVR_OGL_LABORATORY_OFFSCREENCONTEXT_H
+#define VVR_OGL_LABORATORY_OFFSCREENCONTEXT_H
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <vector>
+
+/**
+* An OpenGL 3.3 core context without a window or a display server (EGL, surfaceless), with a
+* framebuffer to draw into instead of the window's. It runs on build machines without a GPU
+* through Mesa's llvmpipe (EGL_PLATFORM=surfaceless is picked when the driver supports it).
+* GLEW is initialized for the context.
+*
+*   OffscreenContext offscreen(1024, 768);
+*   glBindFramebuffer(GL_FRAMEBUFFER, offscreen.frameBuffer());
+*   //draw
+*   std::vector<unsigned char> rgba = offscreen.readPixels();
+*/
+class OffscreenContext {
+public:
+    //Throws runtime_error when there is no EGL display or no 3.3 core context
+    OffscreenContext(int _width, int _height);
+    ~OffscreenContext();
+    OffscreenContext(const OffscreenContext&) = delete;
+    OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+    //RGBA8 color and GL_DEPTH24_STENCIL8 depth (the format OITBuffer blits from)
+    GLuint frameBuffer() const { return framebuffer; }
+    int width, height;
+
+    //The color of the framebuffer, RGBA from the bottom row up. Waits for the GPU
+    std::vector<unsigned char> readPixels() const;
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    GLuint framebuffer = 0;
+    GLuint colorRenderbuffer = 0, depthRenderbuffer = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_OFFSCREENCONTEXT_H
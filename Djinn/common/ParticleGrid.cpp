@@ -0,0 +1,118 @@
+#include "ParticleGrid.h"
+#include <algorithm>
+#include <numeric>
+#include <execution>
+
+using namespace glm;
+
+ParticleGrid::ParticleGrid(float _cell_size) : cell_size(_cell_size) {}
+
+ivec3 ParticleGrid::cellOf(vec3 position) const {
+    return ivec3(floor(position / cell_size));
+}
+
+int ParticleGrid::bucketOf(ivec3 cell) const {
+    //Spatial hash of Teschner et al. (2003) over y and z, the table size is a power of two.
+    //x is added afterwards, so the cells of a row are consecutive buckets
+    unsigned int h = ((unsigned int)cell.y * 19349663u) ^ ((unsigned int)cell.z * 83492791u);
+    return (h + (unsigned int)cell.x) & (table_size - 1);
+}
+
+void ParticleGrid::build(const std::vector<vec3>& positions) {
+    int n = positions.size();
+
+    int wanted = 64;
+    while (wanted < 2 * n) wanted <<= 1;
+    if (wanted != table_size) {
+        table_size = wanted;
+        bucket_counters = std::vector<std::atomic<int>>(table_size);
+        bucket_sizes.resize(table_size + 1);
+        bucket_start.resize(table_size + 1);
+        bucket_ids.resize(table_size);
+        std::iota(bucket_ids.begin(), bucket_ids.end(), 0);
+    }
+    if ((int) particle_ids.size() != n) {
+        particle_ids.resize(n);
+        std::iota(particle_ids.begin(), particle_ids.end(), 0);
+    }
+    particle_buckets.resize(n);
+    sorted_particles.resize(n);
+
+    //1. Bucket of every particle and the size of every bucket
+    std::for_each(std::execution::par, bucket_counters.begin(), bucket_counters.end(),
+        [](std::atomic<int>& c) { c.store(0, std::memory_order_relaxed); });
+    std::transform(std::execution::par, positions.begin(), positions.end(), particle_buckets.begin(),
+        [this](const vec3& p) { return bucketOf(cellOf(p)); });
+    std::for_each(std::execution::par, particle_buckets.begin(), particle_buckets.end(),
+        [this](int b) { bucket_counters[b].fetch_add(1, std::memory_order_relaxed); });
+
+    //2. Where every bucket starts: exclusive prefix sum of the sizes
+    //(into another vector, the parallel scan doesn't work in place)
+    std::transform(std::execution::par, bucket_counters.begin(), bucket_counters.end(), bucket_sizes.begin(),
+        [](const std::atomic<int>& c) { return c.load(std::memory_order_relaxed); });
+    bucket_sizes[table_size] = 0;
+    std::exclusive_scan(std::execution::par, bucket_sizes.begin(), bucket_sizes.end(), bucket_start.begin(), 0);
+
+    //3. Scatter the particles to their buckets, the counters are reused as write cursors
+    std::for_each(std::execution::par, bucket_ids.begin(), bucket_ids.end(),
+        [this](int b) { bucket_counters[b].store(bucket_start[b], std::memory_order_relaxed); });
+    std::for_each(std::execution::par, particle_ids.begin(), particle_ids.end(), [this](int i) {
+        sorted_particles[bucket_counters[particle_buckets[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+    });
+
+    //4. The scatter order inside a bucket depends on the threads, sort them so the queries are deterministic
+    std::for_each(std::execution::par, bucket_ids.begin(), bucket_ids.end(), [this](int b) {
+        int start = bucket_start[b], end = bucket_start[b + 1];
+        if (end - start > 1) std::sort(sorted_particles.begin() + start, sorted_particles.begin() + end);
+    });
+}
+
+gridRange ParticleGrid::bucketParticles(int bucket) const {
+    return bucketsParticles(bucket, bucket);
+}
+
+gridRange ParticleGrid::bucketsParticles(int first_bucket, int last_bucket) const {
+    const int* base = sorted_particles.data();
+    return { base + bucket_start[first_bucket], base + bucket_start[last_bucket + 1] };
+}
+
+gridRange ParticleGrid::particles() const {
+    const int* base = sorted_particles.data();
+    return { base, base + sorted_particles.size() };
+}
+
+int ParticleGrid::neighborRanges(vec3 position, gridRange ranges[18]) const {
+    if (table_size == 0) return 0;
+
+    //First bucket of every row of 3 cells along x
+    ivec3 center = cellOf(position);
+    int rows[9];
+    int row_count = 0;
+    for (int z = -1; z <= 1; z++) {
+        for (int y = -1; y <= 1; y++) {
+            rows[row_count++] = bucketOf(center + ivec3(-1, y, z));
+        }
+    }
+
+    int mask = table_size - 1;
+    int count = 0;
+    for (int r = 0; r < 9; r++) {
+        //Buckets of this row that are not in an earlier one, runs of them become ranges
+        int run_first = -1, run_last = -1;
+        for (int x = 0; x < 3; x++) {
+            int b = (rows[r] + x) & mask;
+            bool visited = false;
+            for (int q = 0; q < r; q++) visited |= ((b - rows[q]) & mask) < 3;
+            if (visited) continue;
+
+            if (run_first >= 0 && b == run_last + 1) {
+                run_last = b;
+                continue;
+            }
+            if (run_first >= 0) ranges[count++] = bucketsParticles(run_first, run_last);
+            run_first = run_last = b;
+        }
+        if (run_first >= 0) ranges[count++] = bucketsParticles(run_first, run_last);
+    }
+    return count;
+}
@@ -0,0 +1,79 @@
+#ifndef VVR_OGL_LABORATORY_PARTICLEGRID_H
+#define VVR_OGL_LABORATORY_PARTICLEGRID_H
+#include <vector>
+#include <atomic>
+#include <glm/glm.hpp>
+
+//Indices of particles of the grid: the ones of a few neighboring buckets, or all of them
+struct gridRange {
+    const int* first;
+    const int* last;
+    const int* begin() const { return first; }
+    const int* end() const { return last; }
+    int size() const { return last - first; }
+};
+
+/**
+* Uniform grid over an unbounded space for neighbor searches between particles. The cells are
+* hashed into a table of buckets that is about twice the particle count, and the particles are
+* sorted by bucket with a parallel counting sort on every rebuild.
+* Every particle within cell_size of a point lies in one of the 27 cells around it. The hash keeps
+* the cells along x in consecutive buckets, so those are 9 ranges of the sorted particles:
+*
+*   grid.build(positions);
+*   grid.forEachNeighbor(positions[i], [&](int j) { ... });
+*
+* Different cells may share a bucket, so the callback can also get particles that are further
+* away and has to check the distance. No GL calls, it can be used from the parallel updates.
+* Queries in the order of particles() find the ranges of the previous one in the cache:
+*
+*   std::for_each(std::execution::par, grid.particles().begin(), grid.particles().end(), [&](int i) { ... });
+*/
+class ParticleGrid {
+public:
+    float cell_size;
+
+    ParticleGrid(float _cell_size = 1.0f);
+
+    //Rebuilds the grid for these positions, the ids in the queries are indices in this vector
+    void build(const std::vector<glm::vec3>& positions);
+
+    glm::ivec3 cellOf(glm::vec3 position) const;
+    int bucketOf(glm::ivec3 cell) const;
+
+    gridRange bucketParticles(int bucket) const;
+    //Every particle once, ordered by bucket
+    gridRange particles() const;
+
+    //Writes the ranges that cover the 27 cells around the position, without a bucket twice, and
+    //returns how many there are. A range per row of 3 cells, split where the table wraps around
+    //or where a row shares buckets with an earlier one
+    int neighborRanges(glm::vec3 position, gridRange ranges[18]) const;
+
+    template<typename Callback>
+    void forEachNeighbor(glm::vec3 position, Callback callback) const {
+        gridRange ranges[18];
+        int count = neighborRanges(position, ranges);
+        for (int r = 0; r < count; r++) {
+            for (int j : ranges[r]) callback(j);
+        }
+    }
+
+    int particleCount() const { return sorted_particles.size(); }
+    int bucketCount() const { return table_size; }
+
+private:
+    int table_size = 0;
+    std::vector<int> particle_buckets;   //bucket of every particle
+    std::vector<int> bucket_sizes;
+    std::vector<int> bucket_start;       //first entry of every bucket in sorted_particles (table_size + 1)
+    std::vector<int> sorted_particles;   //particle ids ordered by bucket
+    std::vector<std::atomic<int>> bucket_counters;
+    //0..n-1 and 0..table_size-1, the index ranges of the parallel loops
+    std::vector<int> particle_ids;
+    std::vector<int> bucket_ids;
+
+    gridRange bucketsParticles(int first_bucket, int last_bucket) const;
+};
+
+#endif //VVR_OGL_LABORATORY_PARTICLEGRID_H
@@ -0,0 +1,248 @@
+#include "ParticleRenderer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstddef>
+
+#ifdef USE_PARALLEL_TRANSFORM
+    #include <execution>
+#endif // USE_PARALLEL_TRANSFORM
+
+ParticleRenderer::ParticleRenderer(Drawable* _model) : model(_model) {
+    configureVAOs();
+}
+
+ParticleRenderer::ParticleRenderer(Drawable* _model, bool instance_buffers) : model(_model) {
+    if (instance_buffers) configureVAOs();
+}
+
+//Deleting the name 0 is ignored, so this also works when the buffers were never created
+ParticleRenderer::~ParticleRenderer() {
+    glDeleteBuffers(1, &transformations_buffer);
+    glDeleteBuffers(1, &rotations_buffer);
+    glDeleteBuffers(1, &scales_buffer);
+    glDeleteBuffers(1, &lifes_buffer);
+    glDeleteBuffers(1, &instances_buffer);
+    glDeleteVertexArrays(1, &matrixVAO);
+    glDeleteVertexArrays(1, &billboardVAO);
+}
+
+void ParticleRenderer::render(IntParticleEmitter& emitter) {
+    if (emitter.alive_list.size() == 0) return;
+    bindAndUpdateBuffers(emitter);
+    glDrawElementsInstanced(GL_TRIANGLES, 3 * model->indices.size(), GL_UNSIGNED_INT, 0, emitter.alive_list.size());
+}
+
+void ParticleRenderer::bindAndUpdateBuffers(IntParticleEmitter& emitter)
+{
+    int live = emitter.alive_list.size();
+
+    if (emitter.use_sorting) {
+        ProfileScope scope("sort");
+        emitter.sortAliveList();
+    }
+    ProfileScope scope("upload");
+
+    if (emitter.use_billboards) {
+        updateInstanceBuffer(emitter);
+        return;
+    }
+
+    //The arrays only grow, to the largest number of live particles drawn so far
+    if (translations.size() < live) {
+        translations.resize(live);
+        rotations.resize(live);
+        scales.resize(live);
+        lifes.resize(live);
+    }
+
+#ifdef USE_PARALLEL_TRANSFORM
+    //Calculate the model matrix in parallel to save performance
+    std::transform(std::execution::par_unseq, emitter.alive_list.begin(), emitter.alive_list.end(), translations.begin(),
+        [&emitter](int i)->glm::mat4 {
+            const particleAttributes& p = emitter.p_attributes[i];
+            return glm::translate(glm::mat4(), glm::mix(p.prev_position, p.position, emitter.interpolation_alpha));
+        });
+
+    if(emitter.use_rotations)
+         std::transform(std::execution::par_unseq, emitter.alive_list.begin(), emitter.alive_list.end(), rotations.begin(),
+            [&emitter](int i)->glm::mat4 {
+                const particleAttributes& p = emitter.p_attributes[i];
+                return glm::rotate(glm::mat4(), glm::radians(p.rot_angle), p.rot_axis);
+            });
+    else {
+        std::fill(rotations.begin(), rotations.begin() + live, glm::mat4(1.0f));
+    }
+
+    std::transform(std::execution::par_unseq, emitter.alive_list.begin(), emitter.alive_list.end(), scales.begin(),
+        [&emitter](int i)->float {
+            return emitter.p_attributes[i].mass;
+        });
+    std::transform(std::execution::par_unseq, emitter.alive_list.begin(), emitter.alive_list.end(), lifes.begin(),
+        [&emitter](int i)->float {
+            return emitter.p_attributes[i].life;
+        });
+
+#else
+    for (int k = 0; k < live; k++) {
+        auto& p = emitter.p_attributes[emitter.alive_list[k]];
+        translations[k] = glm::translate(glm::mat4(), glm::mix(p.prev_position, p.position, emitter.interpolation_alpha));
+    }
+
+    if(emitter.use_rotations)
+        for (int k = 0; k < live; k++) {
+            auto& p = emitter.p_attributes[emitter.alive_list[k]];
+            rotations[k] = glm::rotate(glm::mat4(), glm::radians(p.rot_angle), p.rot_axis);
+        }
+    else {
+        std::fill(rotations.begin(), rotations.begin() + live, glm::mat4(1.0f));
+    }
+
+    for (int k = 0; k < live; k++) {
+        auto& p = emitter.p_attributes[emitter.alive_list[k]];
+        scales[k] = p.mass;
+        lifes[k] = p.life;
+    }
+#endif // USE_PARALLEL_TRANSFORM
+
+    //Bind the VAO
+    glBindVertexArray(matrixVAO);
+
+    //Send transformation data to the GPU
+    glBindBuffer(GL_ARRAY_BUFFER, transformations_buffer);
+    glBufferData(GL_ARRAY_BUFFER, live * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
+    glBufferSubData(GL_ARRAY_BUFFER, 0, live * sizeof(glm::mat4), &translations[0]); //Sending data
+
+    glBindBuffer(GL_ARRAY_BUFFER, rotations_buffer);
+    glBufferData(GL_ARRAY_BUFFER, live * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
+    glBufferSubData(GL_ARRAY_BUFFER, 0, live * sizeof(glm::mat4), &rotations[0]); //Sending data
+
+    glBindBuffer(GL_ARRAY_BUFFER, scales_buffer);
+    glBufferData(GL_ARRAY_BUFFER, live * sizeof(float), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
+    glBufferSubData(GL_ARRAY_BUFFER, 0, live * sizeof(float), &scales[0]); //Sending data
+
+    glBindBuffer(GL_ARRAY_BUFFER, lifes_buffer);
+    glBufferData(GL_ARRAY_BUFFER, live * sizeof(float), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
+    glBufferSubData(GL_ARRAY_BUFFER, 0, live * sizeof(float), &lifes[0]); //Sending data
+}
+
+void ParticleRenderer::updateInstanceBuffer(IntParticleEmitter& emitter)
+{
+    int live = emitter.alive_list.size();
+
+    if (instances.size() < live) instances.resize(live);
+
+    auto toInstance = [&emitter](int i)->particleInstance {
+        const particleAttributes& p = emitter.p_attributes[i];
+        return { glm::mix(p.prev_position, p.position, emitter.interpolation_alpha), p.mass, p.life, glm::radians(p.rot_angle) };
+    };
+#ifdef USE_PARALLEL_TRANSFORM
+    std::transform(std::execution::par_unseq, emitter.alive_list.begin(), emitter.alive_list.end(), instances.begin(), toInstance);
+#else
+    std::transform(emitter.alive_list.begin(), emitter.alive_list.end(), instances.begin(), toInstance);
+#endif // USE_PARALLEL_TRANSFORM
+
+    glBindVertexArray(billboardVAO);
+
+    //One interleaved stream instead of four
+    glBindBuffer(GL_ARRAY_BUFFER, instances_buffer);
+    glBufferData(GL_ARRAY_BUFFER, live * sizeof(particleInstance), NULL, GL_STREAM_DRAW); // Buffer orphaning
+    glBufferSubData(GL_ARRAY_BUFFER, 0, live * sizeof(particleInstance), &instances[0]);
+}
+
+void ParticleRenderer::bindModelAttributes()
+{
+    //We are using the model's buffer but since they are already in the GPU from the Drawable's constructor we just need to configure 
+    //our own VAO by using glVertexAttribPointer and glEnableVertexAttribArray but without sending any data with glBufferData.
+    glBindBuffer(GL_ARRAY_BUFFER, model->verticesVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    if (model->indexedNormals.size() != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, model->normalsVBO);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(1);
+    }
+
+
+    if (model->indexedUVS.size() != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, model->uvsVBO);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(2);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->elementVBO);
+}
+
+void ParticleRenderer::configureVAOs()
+{
+    //Matrix mode. The attributes of the other mode stay disabled, so a draw never reads
+    //a buffer that isn't uploaded in this mode
+    glGenVertexArrays(1, &matrixVAO);
+    glBindVertexArray(matrixVAO);
+    bindModelAttributes();
+
+    //GLSL treats mat4 data as 4 vec4. So we need to enable attributes 3,4,5 and 6, one for each vec4
+    glGenBuffers(1, &transformations_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, transformations_buffer);
+    std::size_t vec4Size = sizeof(glm::vec4);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(1 * vec4Size));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
+
+    //This tells opengl how each particle should get data its slice of data from the mat4
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribDivisor(6, 1);
+
+    glGenBuffers(1, &rotations_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, rotations_buffer);
+
+    glEnableVertexAttribArray(7);
+    glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
+    glEnableVertexAttribArray(8);
+    glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(1 * vec4Size));
+    glEnableVertexAttribArray(9);
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
+    glEnableVertexAttribArray(10);
+    glVertexAttribPointer(10, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
+
+    glVertexAttribDivisor(7, 1);
+    glVertexAttribDivisor(8, 1);
+    glVertexAttribDivisor(9, 1);
+    glVertexAttribDivisor(10, 1);
+
+    glGenBuffers(1, &scales_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, scales_buffer);
+    glEnableVertexAttribArray(11);
+    glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+    glVertexAttribDivisor(11, 1);
+
+    glGenBuffers(1, &lifes_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, lifes_buffer);
+    glEnableVertexAttribArray(12);
+    glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+    glVertexAttribDivisor(12, 1);
+
+    //Billboard mode: position and scale in 13, life and spin in 14
+    glGenVertexArrays(1, &billboardVAO);
+    glBindVertexArray(billboardVAO);
+    bindModelAttributes();
+
+    glGenBuffers(1, &instances_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instances_buffer);
+    glEnableVertexAttribArray(13);
+    glVertexAttribPointer(13, 4, GL_FLOAT, GL_FALSE, sizeof(particleInstance), (void*)offsetof(particleInstance, position));
+    glVertexAttribDivisor(13, 1);
+    glEnableVertexAttribArray(14);
+    glVertexAttribPointer(14, 2, GL_FLOAT, GL_FALSE, sizeof(particleInstance), (void*)offsetof(particleInstance, life));
+    glVertexAttribDivisor(14, 1);
+
+    glBindVertexArray(0);
+}
+
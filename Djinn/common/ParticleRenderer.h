@@ -0,0 +1,59 @@
+#ifndef VVR_OGL_LABORATORY_PARTICLERENDERER_H
+#define VVR_OGL_LABORATORY_PARTICLERENDERER_H
+#include <GL/glew.h>
+#include "IntParticleEmitter.h"
+#include "model.h"
+
+// #define USE_PARALLEL_TRANSFORM
+
+//Per instance data of the billboard render mode, the orientation is built in the vertex shader
+//from the camera right/up vectors (24 bytes instead of two mat4, a scale and a life)
+struct particleInstance {
+    glm::vec3 position;
+    float scale;
+    float life;
+    float spin; //radians, rotation around the view direction
+};
+
+//GL side of the particles: draws the live particles of an emitter as instances of a Drawable.
+//The emitters themselves only simulate, so they can be used without a GL context.
+class ParticleRenderer {
+public:
+    ParticleRenderer(Drawable* _model);
+    virtual ~ParticleRenderer();
+
+    //Uploads the live particles of the emitter and draws them with the currently bound program
+    virtual void render(IntParticleEmitter& emitter);
+    //The emitter that is drawn was replaced, forget what was kept for the old one
+    virtual void reset() {}
+
+protected:
+    Drawable* model;
+
+    //For renderers that keep their own instance data, the buffers of this class aren't created
+    ParticleRenderer(Drawable* _model, bool instance_buffers);
+
+private:
+    //One VAO per render mode, each enables only the instance streams that its mode uploads
+    GLuint matrixVAO = 0;      //attributes 3-12: translation and rotation matrices, scale, life
+    GLuint billboardVAO = 0;   //attributes 13-14: particleInstance
+
+    std::vector<glm::mat4> translations;
+    std::vector<glm::mat4> rotations;
+    std::vector<float> scales;
+    std::vector<float> lifes;
+    std::vector<particleInstance> instances;
+
+    void configureVAOs();
+    //The vertex attributes of the model (0-2) and its index buffer, into the bound VAO
+    void bindModelAttributes();
+    void bindAndUpdateBuffers(IntParticleEmitter& emitter);
+    void updateInstanceBuffer(IntParticleEmitter& emitter);
+    GLuint transformations_buffer = 0;
+    GLuint rotations_buffer = 0;
+    GLuint scales_buffer = 0;
+    GLuint lifes_buffer = 0;
+    GLuint instances_buffer = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_PARTICLERENDERER_H
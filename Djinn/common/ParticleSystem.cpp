@@ -0,0 +1,171 @@
+#include "ParticleSystem.h"
+#include "Profiler.h"
+#include <iostream>
+#include <algorithm>
+#include <execution>
+#include <chrono>
+
+ParticleSystem::ParticleSystem() {}
+
+ParticleSystem::~ParticleSystem() {
+    for (auto& e : entries) {
+        glDeleteQueries(PARTICLE_QUERY_FRAMES, e.timer_queries);
+        delete e.emitter;
+        delete e.renderer;
+    }
+}
+
+int ParticleSystem::addEmitter(IntParticleEmitter* emitter, ParticleRenderer* renderer, GLuint program, const TextureHandle& texture, const char* sampler_name, int max_particles, const std::string& name) {
+    particleSystemEntry e;
+    e.emitter = emitter;
+    e.renderer = renderer;
+    e.program = program;
+    e.texture = texture;
+    e.samplerLocation = glGetUniformLocation(program, sampler_name);
+    e.layerLocation = glGetUniformLocation(program, (std::string(sampler_name) + "Layer").c_str());
+    e.billboardModeLocation = glGetUniformLocation(program, "billboard_mode");
+    e.oitPassLocation = glGetUniformLocation(program, "oit_pass");
+    UniformBufferAllocator::bindBlock(program, "FrameData", FRAME_BLOCK_BINDING);
+    e.max_particles = max_particles;
+    e.min_particles = std::max(1, max_particles / 10);
+    e.update_scope = name + " update";
+    e.draw_scope = name + " draw";
+    glGenQueries(PARTICLE_QUERY_FRAMES, e.timer_queries);
+    emitter->seed(seed_value + entries.size());
+
+    entries.push_back(e);
+    return entries.size() - 1;
+}
+
+int ParticleSystem::addEmitter(IntParticleEmitter* emitter, ParticleRenderer* renderer, GLuint program, textureLayer texture, const char* sampler_name, int max_particles, const std::string& name) {
+    int id = addEmitter(emitter, renderer, program, TextureHandle(), sampler_name, max_particles, name);
+    entries[id].texture_layer = texture;
+    return id;
+}
+
+void ParticleSystem::replaceEmitter(int id, IntParticleEmitter* emitter) {
+    particleSystemEntry& e = entries[id];
+    // Keep the particle count that the budget already settled on
+    emitter->changeParticleNumber(e.emitter->number_of_particles);
+    emitter->seed(seed_value + id);
+    delete e.emitter;
+    e.emitter = emitter;
+    e.renderer->reset();
+}
+
+void ParticleSystem::seed(unsigned int s) {
+    seed_value = s;
+    for (int i = 0; i < entries.size(); i++) {
+        entries[i].emitter->seed(seed_value + i);
+    }
+}
+
+void ParticleSystem::updateParticles(float time, float dt, glm::vec3 camera_pos) {
+    // The emitters don't share any state and don't call GL while updating, so they run in parallel
+    std::for_each(std::execution::par, entries.begin(), entries.end(),
+        [=](particleSystemEntry& e) {
+            if (!e.enabled) return;
+            ProfileScope scope(e.update_scope);
+            auto start = std::chrono::steady_clock::now();
+            e.emitter->updateParticles(time, dt, camera_pos);
+            auto end = std::chrono::steady_clock::now();
+            e.cpu_update_ms = std::chrono::duration<float, std::milli>(end - start).count();
+        });
+}
+
+void ParticleSystem::renderParticles(float alpha, particlePass pass) {
+    if (pass != TRANSPARENT_PARTICLES) readTimerQueries();
+
+    for (auto& e : entries) {
+        if (!e.enabled) continue;
+        if (pass == OPAQUE_PARTICLES && e.transparent) continue;
+        if (pass == TRANSPARENT_PARTICLES && !e.transparent) continue;
+        ProfileScope scope(e.draw_scope);
+
+        glUseProgram(e.program);
+        int billboard_mode = 0;
+        if (e.emitter->use_billboards) billboard_mode = e.emitter->use_rotations ? 1 : 2;
+        glUniform1i(e.billboardModeLocation, billboard_mode);
+        glUniform1i(e.oitPassLocation, pass == TRANSPARENT_PARTICLES ? 1 : 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        if (e.texture_layer.array) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, e.texture_layer.array);
+            glUniform1i(e.layerLocation, e.texture_layer.layer);
+        }
+        else {
+            glBindTexture(GL_TEXTURE_2D, e.texture.texture());
+        }
+        glUniform1i(e.samplerLocation, 0);
+
+        // A query whose result hasn't been read yet can't be reused, skip timing this frame
+        bool timed = !e.query_pending[query_frame];
+        if (timed) glBeginQuery(GL_TIME_ELAPSED, e.timer_queries[query_frame]);
+        e.emitter->interpolation_alpha = alpha;
+        e.renderer->render(*e.emitter);
+        if (timed) {
+            glEndQuery(GL_TIME_ELAPSED);
+            e.query_pending[query_frame] = true;
+        }
+    }
+
+    // The opaque pass is followed by the transparent one in the same frame
+    if (pass == OPAQUE_PARTICLES) return;
+
+    query_frame = (query_frame + 1) % PARTICLE_QUERY_FRAMES;
+
+    if (adaptive_budget) adaptParticleNumbers();
+}
+
+void ParticleSystem::readTimerQueries() {
+    // Results are read a few frames late so that the CPU never waits for the GPU
+    for (auto& e : entries) {
+        for (int i = 0; i < PARTICLE_QUERY_FRAMES; i++) {
+            if (!e.query_pending[i]) continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(e.timer_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(e.timer_queries[i], GL_QUERY_RESULT, &elapsed_ns);
+            e.gpu_draw_ms = elapsed_ns / 1.0e6f;
+            e.query_pending[i] = false;
+            // Timed by these queries, they can't be nested in a GPU scope of the profiler
+            Profiler::instance().recordGPU(e.draw_scope, e.gpu_draw_ms);
+        }
+    }
+}
+
+float ParticleSystem::frameCost() const {
+    float cost = 0.0f;
+    for (const auto& e : entries) {
+        if (e.enabled) cost += e.cpu_update_ms + e.gpu_draw_ms;
+    }
+    return cost;
+}
+
+void ParticleSystem::adaptParticleNumbers() {
+    float cost = frameCost();
+    if (cost <= 0.0f) return;
+
+    float scale = 1.0f;
+    if (cost > frame_budget_ms) {
+        // Over budget: shed particles in proportion, but never more than half per frame
+        scale = std::max(frame_budget_ms / cost, 0.5f);
+    }
+    else if (cost < 0.8f * frame_budget_ms) {
+        // Comfortably inside the budget: slowly give the particles back
+        scale = 1.05f;
+    }
+    if (scale == 1.0f) return;
+
+    for (auto& e : entries) {
+        if (!e.enabled) continue;
+        int current = e.emitter->number_of_particles;
+        int wanted = (int)(current * scale);
+        if (scale > 1.0f) wanted = std::max(wanted, current + 1);
+        wanted = glm::clamp(wanted, e.min_particles, e.max_particles);
+        e.emitter->changeParticleNumber(wanted);
+    }
+}
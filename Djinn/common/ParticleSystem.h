@@ -0,0 +1,97 @@
+#ifndef VVR_OGL_LABORATORY_PARTICLESYSTEM_H
+#define VVR_OGL_LABORATORY_PARTICLESYSTEM_H
+#include <GL/glew.h>
+#include <string>
+#include "IntParticleEmitter.h"
+#include "ParticleRenderer.h"
+#include "UniformBuffer.h"
+#include "TextureManager.h"
+#include "TextureArrays.h"
+
+//Number of frames a GPU timer query is kept in flight before its result is read
+#define PARTICLE_QUERY_FRAMES 3
+
+//Which entries renderParticles draws. With order independent transparency the transparent
+//emitters are drawn into the OIT targets, after the opaque ones
+enum particlePass {
+    ALL_PARTICLES,
+    OPAQUE_PARTICLES,
+    TRANSPARENT_PARTICLES
+};
+
+//An emitter owned by the particle system, together with what is needed to draw it
+struct particleSystemEntry {
+    IntParticleEmitter* emitter = nullptr;
+    ParticleRenderer* renderer = nullptr;
+    bool enabled = true;
+    bool transparent = false; //drawn in the TRANSPARENT_PARTICLES pass
+
+    GLuint program = 0;
+    //A texture of the manager, or a layer of a texture array (a sampler2DArray and an int
+    //uniform "<sampler>Layer" in the program)
+    TextureHandle texture;
+    textureLayer texture_layer;
+    GLuint samplerLocation, layerLocation, billboardModeLocation, oitPassLocation;
+
+    //The adaptive budget moves the particle count inside [min_particles, max_particles]
+    int min_particles = 0;
+    int max_particles = 0;
+
+    //Measured cost of the last frames
+    float cpu_update_ms = 0.0f;
+    float gpu_draw_ms = 0.0f;
+
+    //Profiler scopes of the emitter, "<name> update" and "<name> draw"
+    std::string update_scope, draw_scope;
+
+    GLuint timer_queries[PARTICLE_QUERY_FRAMES];
+    bool query_pending[PARTICLE_QUERY_FRAMES] = {};
+};
+
+//Owns all the emitters of the scene. It updates them in one parallel pass, draws them, measures
+//the CPU update and GPU draw time of every emitter and sheds or restores particles
+//(through changeParticleNumber) so that the particles stay inside frame_budget_ms.
+class ParticleSystem {
+public:
+    float frame_budget_ms = 4.0f;
+    bool adaptive_budget = true;
+
+    ParticleSystem();
+    ~ParticleSystem();
+
+    //Takes ownership of the emitter and of the renderer that draws it and returns its id.
+    //name: how the emitter is shown in the profiler
+    int addEmitter(IntParticleEmitter* emitter, ParticleRenderer* renderer, GLuint program, const TextureHandle& texture, const char* sampler_name, int max_particles, const std::string& name);
+    //The same, for an emitter that samples a layer of a texture array
+    int addEmitter(IntParticleEmitter* emitter, ParticleRenderer* renderer, GLuint program, textureLayer texture, const char* sampler_name, int max_particles, const std::string& name);
+    //Deletes the old emitter of this id and keeps the registration and the renderer
+    void replaceEmitter(int id, IntParticleEmitter* emitter);
+
+    particleSystemEntry& entry(int id) { return entries[id]; }
+    IntParticleEmitter* emitter(int id) { return entries[id].emitter; }
+    //The ids are 0 to emitterCount() - 1
+    int emitterCount() const { return entries.size(); }
+
+    //Seeds every emitter (and the ones that replace them) from one seed, for reproducible runs
+    void seed(unsigned int s);
+
+    void updateParticles(float time, float dt, glm::vec3 camera_pos);
+    //alpha: interpolation factor between the last two simulation steps. PV and the camera axes
+    //come from the FrameData block, which has to be bound at FRAME_BLOCK_BINDING.
+    //The ALL_PARTICLES and TRANSPARENT_PARTICLES passes end the frame (timers and budget),
+    //so OPAQUE_PARTICLES has to be drawn before TRANSPARENT_PARTICLES
+    void renderParticles(float alpha = 1.0f, particlePass pass = ALL_PARTICLES);
+
+    //Total measured cost of the enabled emitters
+    float frameCost() const;
+
+private:
+    std::vector<particleSystemEntry> entries;
+    int query_frame = 0;
+    unsigned int seed_value = 1;
+
+    void readTimerQueries();
+    void adaptParticleNumbers();
+};
+
+#endif //VVR_OGL_LABORATORY_PARTICLESYSTEM_H
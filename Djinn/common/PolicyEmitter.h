@@ -0,0 +1,131 @@
+#ifndef VVR_OGL_LABORATORY_POLICYEMITTER_H
+#define VVR_OGL_LABORATORY_POLICYEMITTER_H
+#include <algorithm>
+#include "IntParticleEmitter.h"
+
+//Settings of an emitter without any besides the ones of IntParticleEmitter
+struct noSettings {};
+
+/**
+* Emitter composed at compile time from behavior policies. The update is one fused loop over the
+* alive list in which every policy call is inlined, and the run time flags that change the loop
+* (use_billboards) are hoisted out of it by instantiating the loop once per value.
+* The virtual IntParticleEmitter interface is only the entry point, once per update.
+* The loop still branches (a dead particle skips the rest) and runs in order, an integrator may
+* carry state from one particle to the next (SmokeIntegrate). The particles are particleAttributes
+* structs, so it isn't vectorized either: what it saves are the virtual calls per particle.
+*
+* A policy is any type with these members (Emitter is the PolicyEmitter they are part of):
+*   Spawn:      void update(Emitter& e, float dt)                  calls e.spawn(count) for the new particles
+*               void create(Emitter& e, particleAttributes& p)     initial state, p.life = 1 marks it alive
+*   Integrate:  void begin()                                       once per update, before the first particle
+*               void integrate(Emitter& e, particleAttributes& p, float dt)
+*   Force:      void apply(particleAttributes& p, float dt)       after the integration
+*   Kill:       bool dead(const Emitter& e, const particleAttributes& p) const    before the particle is moved
+*   RenderData: template<bool billboards> void write(Emitter& e, particleAttributes& p, glm::vec3 camera_pos)
+* The members of Settings are members of the emitter, the policies and the users both see them:
+*
+*   class SmokeEmitter : public PolicyEmitter<SmokeSpawn, SmokeIntegrate, NoForce, SmokeKill, SmokeRenderData, smokeSettings> { ... };
+*/
+template<class Spawn, class Integrate, class Force, class Kill, class RenderData, class Settings = noSettings>
+class PolicyEmitter : public IntParticleEmitter, public Settings {
+public:
+    Spawn spawner;
+    Integrate integrator;
+    Force force;
+    Kill killer;
+    RenderData render_data;
+
+    int active_particles = 0; //number of particles that have been instantiated
+
+    PolicyEmitter(int number) : IntParticleEmitter(number) {}
+
+    void createNewParticle(int index) final {
+        spawner.create(*this, p_attributes[index]);
+    }
+
+    void updateParticles(float time, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) final {
+        beginUpdate();
+        spawner.update(*this, dt);
+
+        if (use_billboards) updateAlive<true>(dt, camera_pos);
+        else updateAlive<false>(dt, camera_pos);
+
+        compactAliveList();
+    }
+
+    //Same as spawnParticles, without the virtual createNewParticle call per particle
+    int spawn(int count) {
+        int spawned = 0;
+        while (spawned < count && !free_list.empty()) {
+            int index = free_list.back();
+            free_list.pop_back();
+            particleAttributes& particle = p_attributes[index];
+            spawner.create(*this, particle);
+            particle.prev_position = particle.position; //nothing to interpolate from yet
+            alive_list.push_back(index);
+            spawned++;
+        }
+        stats.spawned += spawned;
+        stats.live = alive_list.size();
+        return spawned;
+    }
+
+private:
+    template<bool billboards>
+    void updateAlive(float dt, glm::vec3 camera_pos) {
+        integrator.begin();
+        for (int i : alive_list) {
+            particleAttributes& particle = p_attributes[i];
+
+            if (killer.dead(*this, particle)) {
+                killParticle(i);
+                continue;
+            }
+
+            particle.prev_position = particle.position;
+            integrator.integrate(*this, particle, dt);
+            force.apply(particle, dt);
+            render_data.template write<billboards>(*this, particle, camera_pos);
+        }
+    }
+};
+
+// ----------------------------- Generic policies -----------------------------
+
+//Ramps the particles up by batch per update instead of spawning all of them at once,
+//then recycles the ones that died. Derive from it and add create()
+struct RampSpawn {
+    int batch = 50;
+
+    template<class Emitter>
+    void update(Emitter& e, float dt) {
+        if (e.active_particles < e.number_of_particles) {
+            e.active_particles += e.spawn(std::min(e.number_of_particles - e.active_particles, batch));
+        }
+        else {
+            //In case the emitter was resized to a smaller particle number
+            e.active_particles = e.number_of_particles;
+            e.spawn(e.free_list.size());
+        }
+    }
+};
+
+struct NoForce {
+    void apply(particleAttributes& particle, float dt) {}
+};
+
+//Billboard rotation (only without shader billboards) and the distance for the depth sorting
+struct CameraRenderData {
+    template<bool billboards, class Emitter>
+    void write(Emitter& e, particleAttributes& particle, glm::vec3 camera_pos) {
+        if constexpr (!billboards) {
+            auto bill_rot = e.calculateBillboardRotationMatrix(particle.position, camera_pos);
+            particle.rot_axis = glm::vec3(bill_rot.x, bill_rot.y, bill_rot.z);
+            particle.rot_angle = glm::degrees(bill_rot.w);
+        }
+        particle.dist_from_camera = glm::length(particle.position - camera_pos);
+    }
+};
+
+#endif //VVR_OGL_LABORATORY_POLICYEMITTER_H
@@ -0,0 +1,320 @@
+#include "Profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+//The scopes that are open on this thread, the innermost last
+struct openScope {
+    std::string name;
+    std::string key;
+    int64_t start_us;
+};
+static thread_local std::vector<openScope> open_scopes;
+static thread_local int thread_index = 0;
+
+//Weight of the newest frame in the smoothed timings of the overlay
+static const float SMOOTHING = 0.1f;
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : origin(std::chrono::steady_clock::now()) {
+    threadIndex();
+}
+
+int64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+int Profiler::threadIndex() {
+    if (thread_index == 0) thread_index = ++threads;
+    return thread_index;
+}
+
+void Profiler::beginScope(const std::string& name) {
+    std::string key = open_scopes.empty() ? name : open_scopes.back().key + "/" + name;
+    open_scopes.push_back({ name, key, now() });
+}
+
+void Profiler::endScope() {
+    if (open_scopes.empty()) return;
+    openScope scope = open_scopes.back();
+    open_scopes.pop_back();
+    if (!enabled) return;
+
+    profileEvent event;
+    event.name = scope.name;
+    event.key = scope.key;
+    event.depth = open_scopes.size();
+    event.thread = threadIndex();
+    event.start_us = scope.start_us;
+    event.duration_us = now() - scope.start_us;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current.events.push_back(std::move(event));
+}
+
+void Profiler::beginGPUScope(const std::string& name) {
+    beginScope(name);
+    if (gpu_depth++ > 0 || !enabled) return;
+
+    GLuint query;
+    if (!free_queries.empty()) {
+        query = free_queries.back();
+        free_queries.pop_back();
+    }
+    else {
+        glGenQueries(1, &query);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    gpu_open = true;
+    open_query.query = query;
+    open_query.frame = current.number;
+}
+
+void Profiler::endGPUScope() {
+    if (--gpu_depth == 0 && gpu_open && !open_scopes.empty()) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpu_open = false;
+
+        const openScope& scope = open_scopes.back();
+        open_query.event.name = scope.name;
+        open_query.event.key = scope.key;
+        open_query.event.depth = open_scopes.size() - 1;
+        open_query.event.thread = 0;
+        open_query.event.start_us = scope.start_us;
+        pending.push_back(open_query);
+    }
+    endScope();
+}
+
+void Profiler::recordGPU(const std::string& name, float ms) {
+    if (!enabled) return;
+    std::string key = open_scopes.empty() ? name : open_scopes.back().key + "/" + name;
+    frame_gpu_ms[key] += ms;
+}
+
+void Profiler::beginFrame() {
+    profileFrame finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = std::move(current);
+        current = profileFrame();
+        current.number = finished.number + 1;
+        current.start_us = now();
+    }
+    finished.duration_us = current.start_us - finished.start_us;
+
+    if (finished.number == 0) {
+        startup = std::move(finished);
+    }
+    else {
+        frame_ms = finished.duration_us / 1000.0f;
+        frame_plot.push_back(frame_ms);
+        if (frame_plot.size() > PROFILER_PLOT_FRAMES) frame_plot.erase(frame_plot.begin());
+
+        accumulate(finished);
+        history.push_back(std::move(finished));
+        if (history.size() > PROFILER_TRACE_FRAMES) history.pop_front();
+    }
+
+    //The times that recordGPU got, they are already a few frames late
+    for (const auto& recorded : frame_gpu_ms) smoothGPU(recorded.first, recorded.second);
+    frame_gpu_ms.clear();
+
+    readQueries();
+}
+
+void Profiler::accumulate(const profileFrame& frame) {
+    //The scopes in the order they started, so that a new row comes after its parent
+    std::vector<const profileEvent*> events;
+    for (const profileEvent& event : frame.events) {
+        if (event.thread != 0) events.push_back(&event);
+    }
+    std::sort(events.begin(), events.end(), [](const profileEvent* a, const profileEvent* b) {
+        return a->start_us < b->start_us;
+    });
+
+    std::map<std::string, float> cpu_ms;
+    for (const profileEvent* event : events) {
+        auto found = scope_stats.find(event->key);
+        if (found == scope_stats.end()) {
+            profileStat stat;
+            stat.name = event->name;
+            stat.depth = event->depth;
+            stat.order = scope_stats.size();
+            found = scope_stats.emplace(event->key, stat).first;
+            //Measured the first time, no smoothing from zero
+            found->second.cpu_ms = -1.0f;
+        }
+        cpu_ms[event->key] += event->duration_us / 1000.0f;
+    }
+
+    //Scopes that didn't run in this frame fade out
+    for (auto& entry : scope_stats) {
+        profileStat& stat = entry.second;
+        auto measured = cpu_ms.find(entry.first);
+        float ms = measured == cpu_ms.end() ? 0.0f : measured->second;
+        stat.cpu_ms = stat.cpu_ms < 0.0f ? ms : stat.cpu_ms + SMOOTHING * (ms - stat.cpu_ms);
+        stat.total_cpu_ms += ms;
+        stat.frames++;
+    }
+}
+
+//The GPU time goes to the row of the CPU side of the scope
+void Profiler::smoothGPU(const std::string& key, float ms) {
+    auto found = scope_stats.find(key);
+    if (found == scope_stats.end()) return;
+    profileStat& stat = found->second;
+    stat.gpu_ms = stat.has_gpu ? stat.gpu_ms + SMOOTHING * (ms - stat.gpu_ms) : ms;
+    stat.has_gpu = true;
+    stat.total_gpu_ms += ms;
+    stat.gpu_frames++;
+}
+
+void Profiler::resetTotals() {
+    for (auto& entry : scope_stats) {
+        entry.second.total_cpu_ms = entry.second.total_gpu_ms = 0.0;
+        entry.second.frames = entry.second.gpu_frames = 0;
+    }
+}
+
+void Profiler::readQueries() {
+    //GPU time per frame and scope, a stalled frame may deliver the results of several frames at once
+    std::map<uint64_t, std::map<std::string, float>> results;
+
+    for (int i = 0; i < pending.size(); ) {
+        pendingQuery& p = pending[i];
+        GLint available = 0;
+        glGetQueryObjectiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            i++;
+            continue;
+        }
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &elapsed_ns);
+        results[p.frame][p.event.key] += elapsed_ns / 1.0e6f;
+
+        //On the GPU track of its frame, after the GPU scopes that were submitted before it
+        profileEvent event = p.event;
+        event.duration_us = (int64_t) (elapsed_ns / 1000);
+        for (profileFrame& frame : history) {
+            if (frame.number != p.frame) continue;
+            for (const profileEvent& other : frame.events) {
+                if (other.thread == 0) event.start_us = std::max(event.start_us, other.start_us + other.duration_us);
+            }
+            frame.events.push_back(event);
+            break;
+        }
+
+        free_queries.push_back(p.query);
+        pending.erase(pending.begin() + i);
+    }
+
+    for (const auto& frame : results) {
+        for (const auto& scope : frame.second) smoothGPU(scope.first, scope.second);
+    }
+}
+
+void Profiler::drawOverlay() {
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    if (!ImGui::Begin("Profiler", &show_overlay, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("%.2f ms (%.0f fps)", frame_ms, frame_ms > 0.0f ? 1000.0f / frame_ms : 0.0f);
+    ImGui::PlotLines("##frames", frame_plot.data(), frame_plot.size(), 0, "frame ms", 0.0f, 33.3f, ImVec2(320, 60));
+
+    std::vector<const profileStat*> rows;
+    for (const auto& entry : scope_stats) rows.push_back(&entry.second);
+    std::sort(rows.begin(), rows.end(), [](const profileStat* a, const profileStat* b) {
+        return a->order < b->order;
+    });
+
+    if (ImGui::BeginTable("scopes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("scope");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableSetupColumn("GPU ms");
+        ImGui::TableHeadersRow();
+        for (const profileStat* stat : rows) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%*s%s", 2 * stat->depth, "", stat->name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.3f", stat->cpu_ms);
+            ImGui::TableSetColumnIndex(2);
+            if (stat->has_gpu) ImGui::Text("%.3f", stat->gpu_ms);
+            else ImGui::TextDisabled("-");
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+//The names are ours, but a quote or a backslash would break the JSON
+static std::string escapeJSON(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result;
+}
+
+static void writeEvent(std::ofstream& file, bool& first, const std::string& name, int thread, int64_t start_us, int64_t duration_us) {
+    file << (first ? "\n" : ",\n");
+    first = false;
+    file << "{\"name\":\"" << escapeJSON(name) << "\",\"cat\":\"" << (thread == 0 ? "gpu" : "cpu")
+         << "\",\"ph\":\"X\",\"ts\":" << start_us << ",\"dur\":" << duration_us
+         << ",\"pid\":1,\"tid\":" << thread << "}";
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can't write the trace: " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+
+    //Names of the tracks: the GPU, the GL thread and the workers
+    int thread_count = threads;
+    for (int thread = 0; thread <= thread_count; thread++) {
+        std::string name = thread == 0 ? "GPU" : thread == 1 ? "main" : "worker " + std::to_string(thread - 1);
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+             << ",\"args\":{\"name\":\"" << name << "\"}}";
+    }
+
+    auto writeFrame = [&](const profileFrame& frame, const std::string& name) {
+        writeEvent(file, first, name, 1, frame.start_us, frame.duration_us);
+        for (const profileEvent& event : frame.events) {
+            writeEvent(file, first, event.name, event.thread, event.start_us, event.duration_us);
+        }
+    };
+    writeFrame(startup, "startup");
+    for (const profileFrame& frame : history) {
+        writeFrame(frame, "frame " + std::to_string(frame.number));
+    }
+    file << "\n]}\n";
+}
+
+void Profiler::clear() {
+    if (gpu_open) {
+        glEndQuery(GL_TIME_ELAPSED);
+        free_queries.push_back(open_query.query);
+        gpu_open = false;
+    }
+    for (const pendingQuery& p : pending) free_queries.push_back(p.query);
+    if (!free_queries.empty()) glDeleteQueries(free_queries.size(), free_queries.data());
+    free_queries.clear();
+    pending.clear();
+}
@@ -0,0 +1,154 @@
+#ifndef VVR_OGL_LABORATORY_PROFILER_H
+#define VVR_OGL_LABORATORY_PROFILER_H
+#include <GL/glew.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//Frames a GPU timer query is kept in flight before its result is read
+#define PROFILER_QUERY_FRAMES 3
+//Frames kept for the Chrome trace (the frame with the startup loads is always kept)
+#define PROFILER_TRACE_FRAMES 300
+//Frame times in the plot of the overlay
+#define PROFILER_PLOT_FRAMES 120
+
+//A closed scope. thread 0 is the GPU, the CPU threads are numbered from 1 in the order they
+//were first seen (the thread that created the profiler, the GL thread, is 1)
+struct profileEvent {
+    std::string name;
+    std::string key;    //the names of the enclosing scopes and this one, "particles/smoke draw"
+    int depth = 0;
+    int thread = 0;
+    int64_t start_us = 0;  //since the profiler was created
+    int64_t duration_us = 0;
+};
+
+struct profileFrame {
+    uint64_t number = 0;
+    int64_t start_us = 0;
+    int64_t duration_us = 0;
+    std::vector<profileEvent> events;
+};
+
+//Smoothed timings of one scope in the overlay, per frame (summed when it runs more than once)
+struct profileStat {
+    std::string name;
+    int depth = 0;
+    int order = 0;          //first seen, the rows keep the order in which the scopes run
+    float cpu_ms = 0.0f;
+    float gpu_ms = 0.0f;
+    bool has_gpu = false;
+
+    //Sums since the scope was first seen (or resetTotals), for the averages of a whole run
+    double total_cpu_ms = 0.0;
+    double total_gpu_ms = 0.0;
+    int frames = 0;
+    int gpu_frames = 0;
+};
+
+/**
+* CPU scopes (ProfileScope) from any thread and GPU scopes (GPUProfileScope) on the GL thread,
+* collected per frame. The GPU scopes are GL_TIME_ELAPSED queries from a ring that is read a few
+* frames later, so reading them never waits for the GPU. The timings are shown in an ImGui
+* overlay and the last frames can be written as a Chrome trace (chrome://tracing, Perfetto).
+*
+*   Profiler::instance().beginFrame();
+*   {
+*       GPUProfileScope scope("depth pass");
+*       ...
+*   }
+*
+* GL_TIME_ELAPSED queries can't be nested: a GPU scope inside another one is timed on the CPU
+* only, and no GPU scope may be open around code with queries of its own (ParticleSystem, which
+* reports its draw times through recordGPU instead).
+*/
+class Profiler {
+public:
+    bool enabled = true;
+    bool show_overlay = false;
+
+    static Profiler& instance();
+
+    //Closes the previous frame and reads the GPU queries that finished meanwhile
+    void beginFrame();
+
+    void beginScope(const std::string& name);
+    void endScope();
+    //GL thread only
+    void beginGPUScope(const std::string& name);
+    void endGPUScope();
+    //A GPU time that was measured elsewhere, for the scope with this name inside the open one
+    void recordGPU(const std::string& name, float ms);
+
+    //The overlay window, between ImGui::NewFrame and ImGui::Render
+    void drawOverlay();
+    //The kept frames as Chrome trace_event JSON
+    void writeChromeTrace(const std::string& path);
+
+    //Deletes the queries, while the context is still there
+    void clear();
+
+    const std::map<std::string, profileStat>& stats() const { return scope_stats; }
+    //Starts the totals of the stats over, e.g. after the warm-up frames of a benchmark
+    void resetTotals();
+    float frameMs() const { return frame_ms; }
+
+private:
+    Profiler();
+
+    struct pendingQuery {
+        GLuint query;
+        uint64_t frame;
+        profileEvent event;  //the CPU side of the scope, the GPU time replaces the duration
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+
+    profileFrame current;
+    profileFrame startup;           //everything before the first beginFrame: the asset loads
+    std::deque<profileFrame> history;
+
+    std::vector<GLuint> free_queries;
+    std::vector<pendingQuery> pending;
+    bool gpu_open = false;
+    int gpu_depth = 0;  //open GPU scopes, only the outermost one has a query
+    pendingQuery open_query;
+
+    std::map<std::string, profileStat> scope_stats;
+    std::map<std::string, float> frame_gpu_ms;  //recordGPU of the current frame
+    float frame_ms = 0.0f;
+    std::vector<float> frame_plot;
+    std::atomic<int> threads{ 0 };
+
+    int64_t now() const;
+    int threadIndex();
+    void readQueries();
+    void accumulate(const profileFrame& frame);
+    void smoothGPU(const std::string& key, float ms);
+};
+
+//Times the enclosing block on the CPU
+class ProfileScope {
+public:
+    ProfileScope(const std::string& name) { Profiler::instance().beginScope(name); }
+    ~ProfileScope() { Profiler::instance().endScope(); }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+//Times the enclosing block on the CPU and the GL commands it issues on the GPU
+class GPUProfileScope {
+public:
+    GPUProfileScope(const std::string& name) { Profiler::instance().beginGPUScope(name); }
+    ~GPUProfileScope() { Profiler::instance().endGPUScope(); }
+    GPUProfileScope(const GPUProfileScope&) = delete;
+    GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+};
+
+#endif //VVR_OGL_LABORATORY_PROFILER_H
@@ -0,0 +1,252 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+
+RenderQueue::RenderQueue(UniformBufferAllocator& _uniform_buffer) : uniform_buffer(_uniform_buffer) {
+}
+
+int RenderQueue::addMaterial(const renderMaterial& material) {
+    materials.push_back(material);
+    materials.back().block_offset = uniform_buffer.allocate(sizeof(materialBlock));
+    return materials.size() - 1;
+}
+
+void RenderQueue::writeMaterials() {
+    // Only a few dozen bytes each, the alpha of the clouds and the Djinn changes every frame
+    for (const renderMaterial& m : materials) {
+        materialBlock block;
+        block.alpha = m.alpha;
+        block.useTexture = m.use_texture;
+        block.useTransparency = m.use_transparency;
+        block.albedoLayer = m.albedo.layer;
+        block.roughnessLayer = m.roughness.layer;
+        block.metallicLayer = m.metallic.layer;
+        uniform_buffer.write(m.block_offset, block);
+    }
+}
+
+void RenderQueue::beginFrame(glm::vec3 _camera_pos) {
+    camera_pos = _camera_pos;
+    items.clear();
+    frame_stats = renderQueueStats();
+}
+
+void RenderQueue::setFrustum(renderPass pass, const glm::mat4& VP) {
+    frustums[pass] = Frustum(VP);
+    culling[pass] = true;
+}
+
+void RenderQueue::submit(renderPass pass, GLuint program, int material, Drawable* drawable, const glm::mat4& modelMatrix) {
+    renderItem item;
+    item.pass = pass;
+    item.program = program;
+    item.material = material;
+    item.drawable = drawable;
+    item.modelMatrix = modelMatrix;
+    submit(item);
+}
+
+void RenderQueue::submit(renderPass pass, GLuint program, int material, ogl::Model* model, const glm::mat4& modelMatrix) {
+    renderItem item;
+    item.pass = pass;
+    item.program = program;
+    item.material = material;
+    item.model = model;
+    item.modelMatrix = modelMatrix;
+    submit(item);
+}
+
+void RenderQueue::submit(renderPass pass, GLuint program, int material, InstancedDrawable* instanced, const glm::mat4& modelMatrix) {
+    renderItem item;
+    item.pass = pass;
+    item.program = program;
+    item.material = material;
+    item.instanced = instanced;
+    item.modelMatrix = modelMatrix;
+    submit(item);
+}
+
+void RenderQueue::submit(renderItem item) {
+    if (culling[item.pass]) {
+        const boundingVolume& local = item.drawable != nullptr ? item.drawable->bounds
+                                    : item.model != nullptr ? item.model->bounds
+                                    : item.instanced->bounds();
+        if (!frustums[item.pass].intersects(transformBounds(local, item.modelMatrix))) {
+            frame_stats.culled[item.pass]++;
+            return;
+        }
+    }
+    frame_stats.submitted[item.pass]++;
+
+    item.key = sortKey(item);
+    // Kept sorted by insertion, there are a few dozen items per frame
+    auto position = std::upper_bound(items.begin(), items.end(), item,
+        [](const renderItem& a, const renderItem& b) { return a.key < b.key; });
+    items.insert(position, item);
+    frame_stats.items++;
+}
+
+uint64_t RenderQueue::sortKey(const renderItem& item) {
+    auto id = program_ids.find(item.program);
+    if (id == program_ids.end()) id = program_ids.emplace(item.program, program_ids.size()).first;
+
+    // A positive float compares like its bits as an unsigned integer
+    float distance = glm::length(glm::vec3(item.modelMatrix[3]) - camera_pos);
+    uint32_t depth;
+    std::memcpy(&depth, &distance, sizeof(depth));
+
+    uint64_t pass = (uint64_t)item.pass << 62;
+    uint64_t program = id->second & 0xff;
+    uint64_t material = (item.material + 1) & 0xffff;
+
+    // Blending needs back to front, before anything else
+    if (item.pass == TRANSPARENT_PASS) return pass | ((uint64_t)(~depth) << 30) | (program << 22) | (material << 6);
+    // Otherwise the state changes matter most, front to back inside a material for the early depth test
+    return pass | (program << 54) | (material << 38) | depth;
+}
+
+uint64_t RenderQueue::signature(renderPass pass) const {
+    // FNV-1a over the items of the pass, they are already in a deterministic (sorted) order
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (const renderItem& item : items) {
+        if (item.pass != pass) continue;
+        add(&item.drawable, sizeof(item.drawable));
+        add(&item.model, sizeof(item.model));
+        add(&item.instanced, sizeof(item.instanced));
+        add(&item.modelMatrix[0][0], sizeof(item.modelMatrix));
+        if (item.instanced != nullptr) {
+            unsigned int version = item.instanced->version();
+            add(&version, sizeof(version));
+        }
+    }
+    return hash;
+}
+
+RenderQueue::programLocations& RenderQueue::programState(GLuint program) {
+    auto loc = locations.find(program);
+    if (loc != locations.end()) return loc->second;
+
+    programLocations l;
+    l.model = glGetUniformLocation(program, "M");
+    l.instanced = glGetUniformLocation(program, "instanced");
+    l.instanced_value = -1;
+    l.albedoSampler = glGetUniformLocation(program, "albedoColorSampler");
+    l.roughnessSampler = glGetUniformLocation(program, "roughnessColorSampler");
+    l.metallicSampler = glGetUniformLocation(program, "metallicColorSampler");
+
+    // The samplers always read the same units, they are set once
+    glUseProgram(program);
+    glUniform1i(l.albedoSampler, ALBEDO_UNIT);
+    glUniform1i(l.roughnessSampler, ROUGHNESS_UNIT);
+    glUniform1i(l.metallicSampler, METALLIC_UNIT);
+    current_program = program;
+    frame_stats.program_binds++;
+
+    return locations.emplace(program, l).first->second;
+}
+
+void RenderQueue::bindProgram(GLuint program) {
+    if (program == current_program) {
+        frame_stats.skipped_binds++;
+        return;
+    }
+    glUseProgram(program);
+    current_program = program;
+    frame_stats.program_binds++;
+}
+
+void RenderQueue::bindTexture(int unit, GLuint texture) {
+    if (texture == 0) return;
+    if (current_textures[unit] == texture) {
+        frame_stats.skipped_binds++;
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    current_textures[unit] = texture;
+    frame_stats.texture_binds++;
+}
+
+void RenderQueue::bindMaterial(int material) {
+    if (material < 0) return;
+    if (material == current_material) {
+        frame_stats.skipped_binds++;
+        return;
+    }
+    const renderMaterial& m = materials[material];
+    bindTexture(ALBEDO_UNIT, m.albedo.array);
+    bindTexture(ROUGHNESS_UNIT, m.roughness.array);
+    bindTexture(METALLIC_UNIT, m.metallic.array);
+
+    // The binding point is the same for every program, the range stays bound across program changes
+    uniform_buffer.bindRange(MATERIAL_BLOCK_BINDING, m.block_offset, sizeof(materialBlock));
+    frame_stats.ubo_binds++;
+    current_material = material;
+}
+
+void RenderQueue::invalidateState() {
+    current_program = 0;
+    current_vao = 0;
+    current_material = -1;
+    std::fill(std::begin(current_textures), std::end(current_textures), 0);
+}
+
+void RenderQueue::flush(renderPass pass) {
+    // Whatever ran since the last flush may have changed the bindings
+    invalidateState();
+
+    for (const renderItem& item : items) {
+        if (item.pass != pass) continue;
+
+        programLocations& loc = programState(item.program);
+        bindProgram(item.program);
+        bindMaterial(item.material);
+
+        glUniformMatrix4fv(loc.model, 1, GL_FALSE, &item.modelMatrix[0][0]);
+        frame_stats.uniform_updates++;
+
+        // The vertex shader switches between M and M * instanceModel
+        int instanced = item.instanced != nullptr ? 1 : 0;
+        if (loc.instanced_value != instanced) {
+            glUniform1i(loc.instanced, instanced);
+            loc.instanced_value = instanced;
+            frame_stats.uniform_updates++;
+        }
+
+        if (item.drawable != nullptr) {
+            if (item.drawable->VAO != current_vao) {
+                item.drawable->bind();
+                current_vao = item.drawable->VAO;
+                frame_stats.vao_binds++;
+            }
+            else {
+                frame_stats.skipped_binds++;
+            }
+            item.drawable->draw();
+        }
+        else if (item.instanced != nullptr) {
+            // bind also uploads the instances the first time they are drawn after a change
+            if (item.instanced->VAO != current_vao) frame_stats.vao_binds++;
+            else frame_stats.skipped_binds++;
+            item.instanced->bind();
+            current_vao = item.instanced->VAO;
+            item.instanced->draw(item.material);
+            frame_stats.instances += item.instanced->instanceCount(item.material);
+        }
+        else {
+            // Binds the VAO of every mesh itself
+            item.model->draw();
+            current_vao = 0;
+        }
+        frame_stats.draw_calls++;
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,148 @@
+#ifndef VVR_OGL_LABORATORY_RENDERQUEUE_H
+#define VVR_OGL_LABORATORY_RENDERQUEUE_H
+#include <GL/glew.h>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "model.h"
+#include "UniformBuffer.h"
+#include "InstancedDrawable.h"
+#include "TextureArrays.h"
+
+//Passes of a frame, in the order their items are sorted.
+//The static casters of the shadow map are drawn only when the ShadowCache is rebuilt
+enum renderPass {
+    STATIC_DEPTH_PASS,
+    DEPTH_PASS,
+    OPAQUE_PASS,
+    TRANSPARENT_PASS,
+    RENDER_PASS_COUNT
+};
+
+//Maps (layers of TextureArrays) and the MaterialData block of ShadowMapping.fragmentshader.
+//A map without a layer isn't bound and is black in the shader
+struct renderMaterial {
+    textureLayer albedo;
+    textureLayer roughness;
+    textureLayer metallic;
+    float alpha = 1.0f;
+    int use_texture = 0;      //useTexture of the shader
+    int use_transparency = 0; //useTransparency of the shader
+    GLintptr block_offset = 0; //range of the material in the uniform buffer, set by addMaterial
+};
+
+//What is drawn by one draw item: a Drawable (bind + draw), an ogl::Model (draws its own meshes)
+//or the instances of one material of an InstancedDrawable, placed by modelMatrix * instance transform
+struct renderItem {
+    uint64_t key = 0;
+    renderPass pass = OPAQUE_PASS;
+    GLuint program = 0;
+    int material = -1;  //index from addMaterial, -1 for the depth pass
+    Drawable* drawable = nullptr;
+    ogl::Model* model = nullptr;
+    InstancedDrawable* instanced = nullptr;
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+};
+
+//Counters of the current frame
+struct renderQueueStats {
+    int items = 0;
+    int draw_calls = 0;
+    int instances = 0;     //objects drawn by the instanced draw calls
+    int program_binds = 0;
+    int texture_binds = 0;
+    int vao_binds = 0;
+    int uniform_updates = 0;
+    int ubo_binds = 0;     //material ranges bound
+    int skipped_binds = 0; //binds and uniform updates that were already in place
+    //Items of every pass that were inside its frustum (submitted) or not (culled)
+    int submitted[RENDER_PASS_COUNT] = {};
+    int culled[RENDER_PASS_COUNT] = {};
+};
+
+/**
+* Collects the draw items of a frame and submits them sorted by pass, program, material and depth
+* (front to back for the opaque passes, back to front for the transparent one), skipping the binds
+* and the uniform updates that are already in place.
+* Items outside the frustum of their pass (setFrustum) are culled when they are submitted.
+* Every material has its own range in the uniform buffer, so switching materials binds a range
+* instead of setting uniforms. The per frame blocks (FrameData, LightData) and the shadow map
+* are set by the caller before flush.
+*
+*   RenderQueue queue(uniformBuffer);
+*   queue.beginFrame(camera_pos);
+*   queue.submit(DEPTH_PASS, depthProgram, -1, table, tableModelMatrix);
+*   queue.submit(OPAQUE_PASS, shadowMapShaderProgram, tableMaterial, table, tableModelMatrix);
+*   queue.writeMaterials();
+*   uniformBuffer.upload();
+*   queue.flush(DEPTH_PASS);
+*/
+class RenderQueue {
+public:
+    //Texture units of the material texture arrays, unit 0 stays for the shadow map.
+    //Materials whose maps are in the same arrays don't bind anything but their uniform range
+    static const int ALBEDO_UNIT = 1;
+    static const int ROUGHNESS_UNIT = 2;
+    static const int METALLIC_UNIT = 3;
+
+    RenderQueue(UniformBufferAllocator& uniform_buffer);
+
+    int addMaterial(const renderMaterial& material);
+    renderMaterial& material(int id) { return materials[id]; }
+
+    //Clears the items and the counters of the last frame
+    void beginFrame(glm::vec3 camera_pos);
+    //Items of the pass are culled against the planes of this view-projection matrix
+    void setFrustum(renderPass pass, const glm::mat4& VP);
+    void disableCulling(renderPass pass) { culling[pass] = false; }
+    void submit(renderPass pass, GLuint program, int material, Drawable* drawable, const glm::mat4& modelMatrix);
+    void submit(renderPass pass, GLuint program, int material, ogl::Model* model, const glm::mat4& modelMatrix);
+    //Draws the instances of this material, all of them for the depth pass (material -1)
+    void submit(renderPass pass, GLuint program, int material, InstancedDrawable* instanced, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+    //Copies the materials into their uniform buffer ranges, before the buffer is uploaded
+    void writeMaterials();
+
+    //Sorts and draws the items of one pass
+    void flush(renderPass pass);
+    //Forget the bound state, for when other code (the particles, another FBO) used GL in between
+    void invalidateState();
+
+    const renderQueueStats& stats() const { return frame_stats; }
+    //Hash of what a pass draws (objects, model matrices, instances), it changes when anything in it moves
+    uint64_t signature(renderPass pass) const;
+
+private:
+    //Uniform locations that the queue sets, fetched once per program
+    struct programLocations {
+        GLint model, instanced;
+        GLint albedoSampler, roughnessSampler, metallicSampler;
+        int instanced_value; //what the instanced uniform holds now
+    };
+
+    UniformBufferAllocator& uniform_buffer;
+    std::vector<renderMaterial> materials;
+    std::vector<renderItem> items;
+    std::map<GLuint, programLocations> locations;
+    std::map<GLuint, int> program_ids; //small ids for the sort key
+    glm::vec3 camera_pos;
+    renderQueueStats frame_stats;
+    Frustum frustums[RENDER_PASS_COUNT];
+    bool culling[RENDER_PASS_COUNT] = {};
+
+    //State that is bound right now
+    GLuint current_program = 0;
+    GLuint current_vao = 0;
+    GLuint current_textures[4] = {};
+    int current_material = -1;
+
+    void submit(renderItem item);
+    uint64_t sortKey(const renderItem& item);
+    programLocations& programState(GLuint program);
+    void bindProgram(GLuint program);
+    void bindMaterial(int material);
+    void bindTexture(int unit, GLuint texture);
+};
+
+#endif //VVR_OGL_LABORATORY_RENDERQUEUE_H
@@ -0,0 +1,162 @@
+#include "SessionRecorder.h"
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+//"DJSR" and the version of the layout below, little endian like the machines we record on
+static const char MAGIC[4] = { 'D', 'J', 'S', 'R' };
+static const uint32_t VERSION = 1;
+
+//Header: magic, version, seed, deterministic (u8), fixed_dt, max_substeps.
+//Frame: dt, frame_ms, camera position, horizontal and vertical angle, fov, light position and
+//previous position, emitter count (u8) and particle numbers (i32), key count (u8) and keys (i16)
+template <typename T>
+static void put(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool get(std::ifstream& file, T& value) {
+    return (bool) file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+static void putVec3(std::ofstream& file, const glm::vec3& v) {
+    put(file, v.x);
+    put(file, v.y);
+    put(file, v.z);
+}
+
+static bool getVec3(std::ifstream& file, glm::vec3& v) {
+    return get(file, v.x) && get(file, v.y) && get(file, v.z);
+}
+
+void SessionRecorder::record(const std::string& path, const sessionHeader& header) {
+    close();
+    file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can't write the session: " + path);
+    }
+    session_header = header;
+    file.write(MAGIC, sizeof(MAGIC));
+    put(file, VERSION);
+    put(file, header.seed);
+    put(file, (uint8_t) header.deterministic);
+    put(file, header.fixed_dt);
+    put(file, header.max_substeps);
+    mode = RECORDING;
+}
+
+void SessionRecorder::writeFrame(sessionFrame& frame) {
+    if (!recording()) return;
+    frame.keys.insert(frame.keys.end(), pressed.begin(), pressed.end());
+    pressed.clear();
+
+    put(file, frame.dt);
+    put(file, frame.frame_ms);
+    putVec3(file, frame.camera_position);
+    put(file, frame.horizontal_angle);
+    put(file, frame.vertical_angle);
+    put(file, frame.fov);
+    putVec3(file, frame.light_position);
+    putVec3(file, frame.light_previous_position);
+
+    //A handful of emitters and far less than 255 key presses in a frame
+    put(file, (uint8_t) frame.particle_numbers.size());
+    for (int number : frame.particle_numbers) put(file, (int32_t) number);
+    put(file, (uint8_t) frame.keys.size());
+    for (int key : frame.keys) put(file, (int16_t) key);
+}
+
+void SessionRecorder::replay(const std::string& path) {
+    close();
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Can't open the session: " + path);
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint8_t deterministic = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, MAGIC) || !get(in, version)) {
+        throw std::runtime_error(path + " is not a session trace");
+    }
+    if (version != VERSION) {
+        throw std::runtime_error(path + ": unsupported session version " + std::to_string(version));
+    }
+    if (!get(in, session_header.seed) || !get(in, deterministic) || !get(in, session_header.fixed_dt) || !get(in, session_header.max_substeps)) {
+        throw std::runtime_error(path + ": truncated header");
+    }
+    session_header.deterministic = deterministic != 0;
+
+    //A trace that was cut off (the demo crashed) is replayed up to its last whole frame
+    frames.clear();
+    while (true) {
+        sessionFrame frame;
+        uint8_t count;
+        if (!get(in, frame.dt) || !get(in, frame.frame_ms) || !getVec3(in, frame.camera_position) ||
+            !get(in, frame.horizontal_angle) || !get(in, frame.vertical_angle) || !get(in, frame.fov) ||
+            !getVec3(in, frame.light_position) || !getVec3(in, frame.light_previous_position) || !get(in, count)) break;
+
+        bool complete = true;
+        for (int i = 0; i < count && complete; i++) {
+            int32_t number;
+            complete = get(in, number);
+            frame.particle_numbers.push_back(number);
+        }
+        complete = complete && get(in, count);
+        for (int i = 0; i < count && complete; i++) {
+            int16_t key;
+            complete = get(in, key);
+            frame.keys.push_back(key);
+        }
+        if (!complete) break;
+        frames.push_back(std::move(frame));
+    }
+    if (frames.empty()) {
+        throw std::runtime_error(path + ": the session has no frames");
+    }
+
+    next = 0;
+    replay_ms.clear();
+    mode = REPLAYING;
+}
+
+void SessionRecorder::close() {
+    if (file.is_open()) file.close();
+    pressed.clear();
+    mode = IDLE;
+}
+
+void SessionRecorder::writeTimings(const std::string& path) const {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("Can't write the timings: " + path);
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "frame,dt_ms,recorded_ms,replay_ms\n";
+    for (int i = 0; i < replay_ms.size(); i++) {
+        out << i << "," << frames[i].dt * 1000.0f << "," << frames[i].frame_ms << "," << replay_ms[i] << "\n";
+    }
+}
+
+void SessionRecorder::report(std::ostream& out) const {
+    //Mean and the slowest frame of the first count frames
+    auto summary = [&out](const char* name, int count, auto ms) {
+        if (count == 0) return;
+        double sum = 0.0;
+        int slowest = 0;
+        for (int i = 0; i < count; i++) {
+            sum += ms(i);
+            if (ms(i) > ms(slowest)) slowest = i;
+        }
+        out << name << ": " << count << " frames, mean " << sum / count << " ms, slowest frame "
+            << slowest << " (" << ms(slowest) << " ms)" << std::endl;
+    };
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+    summary("recorded", (int) replay_ms.size(), [this](int i) { return frames[i].frame_ms; });
+    summary("replay", (int) replay_ms.size(), [this](int i) { return replay_ms[i]; });
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,88 @@
+#ifndef VVR_OGL_LABORATORY_SESSIONRECORDER_H
+#define VVR_OGL_LABORATORY_SESSIONRECORDER_H
+#include <vector>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+//What the simulation of a session depends on besides its frames
+struct sessionHeader {
+    uint32_t seed = 1;
+    bool deterministic = false;
+    float fixed_dt = 1.0f / 60.0f;
+    int32_t max_substeps = 5;
+};
+
+//Everything a frame took from the input and the wall clock
+struct sessionFrame {
+    float dt = 0.0f;                //what SimulationClock::beginFrame got
+    float frame_ms = 0.0f;          //wall time of the recorded frame, swap included
+    glm::vec3 camera_position;
+    float horizontal_angle = 0.0f, vertical_angle = 0.0f, fov = 45.0f;
+    //The light moves with the keys in every simulation step, its positions after the last one
+    glm::vec3 light_position, light_previous_position;
+    std::vector<int> particle_numbers;  //per emitter, before the simulation (the adaptive budget changes them)
+    std::vector<int> keys;              //pressed while the events were polled at the end of the frame
+};
+
+/**
+* Records a session of the demo into a compact binary trace and plays it back. The trace holds the
+* clock and the seed, and for every frame the dt, the camera and the light, the particle numbers
+* of the emitters and the keys that were pressed. A replay feeds them back instead of the window
+* and the wall clock, so it spawns the same particles and follows the same camera on any machine.
+* The recorded frame times stay in the trace, the replay writes them next to its own (CSV).
+*
+*   SessionRecorder session;
+*   session.record("stutter.djs", header);
+*   //every frame
+*   session.writeFrame(frame);
+*
+*   session.replay("stutter.djs");
+*   while (!session.finished()) {
+*       const sessionFrame& frame = session.nextFrame();
+*       //...
+*       session.replayedFrame(ms);
+*   }
+*   session.writeTimings("stutter.djs.csv");
+*/
+class SessionRecorder {
+public:
+    //Both throw runtime_error when the file can't be opened, replay also for a file that isn't a trace
+    void record(const std::string& path, const sessionHeader& header);
+    void replay(const std::string& path);
+    //Writes what is left of the trace
+    void close();
+
+    bool recording() const { return mode == RECORDING; }
+    bool replaying() const { return mode == REPLAYING; }
+    const sessionHeader& header() const { return session_header; }
+
+    //Recording: a key press of the window, it goes into the frame that is written next
+    void pressKey(int key) { pressed.push_back(key); }
+    void writeFrame(sessionFrame& frame);
+
+    //Replay
+    bool finished() const { return next >= frames.size(); }
+    const sessionFrame& nextFrame() { return frames[next++]; }
+    //Wall time of the frame that nextFrame returned last
+    void replayedFrame(float ms) { replay_ms.push_back(ms); }
+    //frame, dt_ms, recorded_ms, replay_ms
+    void writeTimings(const std::string& path) const;
+    //The mean and the slowest frame of the recording and of the replay
+    void report(std::ostream& out) const;
+
+private:
+    enum sessionMode { IDLE, RECORDING, REPLAYING };
+    sessionMode mode = IDLE;
+    sessionHeader session_header;
+    std::ofstream file;
+    std::vector<int> pressed;
+
+    std::vector<sessionFrame> frames;
+    size_t next = 0;
+    std::vector<float> replay_ms;
+};
+
+#endif //VVR_OGL_LABORATORY_SESSIONRECORDER_H
@@ -0,0 +1,55 @@
+#include "ShaderVariants.h"
+#include "shader.h"
+#include <algorithm>
+
+ShaderVariants::ShaderVariants(const std::string& _vertexFilePath, const std::string& _fragmentFilePath)
+    : vertexFilePath(_vertexFilePath), fragmentFilePath(_fragmentFilePath) {
+}
+
+ShaderVariants::~ShaderVariants() {
+    for (GLuint program : compiled) {
+        glDeleteProgram(program);
+    }
+}
+
+std::string ShaderVariants::variantKey(const shaderDefines& defines) {
+    // The map is ordered, so the same defines always give the same key
+    std::string key;
+    for (const auto& define : defines) {
+        key += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+    }
+    return key;
+}
+
+void ShaderVariants::add(const std::string& key, GLuint program) {
+    if (onCreate) onCreate(program);
+    cache.emplace(key, program);
+    compiled.push_back(program);
+}
+
+GLuint ShaderVariants::program(const shaderDefines& defines) {
+    std::string key = variantKey(defines);
+    auto variant = cache.find(key);
+    if (variant != cache.end()) return variant->second;
+
+    GLuint program = loadShaders(vertexFilePath.c_str(), fragmentFilePath.c_str(), nullptr, key);
+    add(key, program);
+    return program;
+}
+
+void ShaderVariants::preload(const std::vector<shaderDefines>& variants) {
+    std::vector<std::string> keys;
+    std::vector<programSource> sources;
+    for (const shaderDefines& defines : variants) {
+        std::string key = variantKey(defines);
+        if (cache.count(key) || std::find(keys.begin(), keys.end(), key) != keys.end()) continue;
+        keys.push_back(key);
+        sources.push_back({ vertexFilePath.c_str(), fragmentFilePath.c_str(), nullptr, key });
+    }
+    if (sources.empty()) return;
+
+    std::vector<GLuint> programs = loadShaderBatch(sources);
+    for (int i = 0; i < programs.size(); i++) {
+        add(keys[i], programs[i]);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef VVR_OGL_LABORATORY_SHADERVARIANTS_H
+#define VVR_OGL_LABORATORY_SHADERVARIANTS_H
+#include <GL/glew.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+//Macros of one variant, each one becomes "#define name value"
+typedef std::map<std::string, int> shaderDefines;
+
+/**
+* The specialized programs of one vertex/fragment shader pair. Every set of defines is compiled
+* the first time it is asked for and then kept, so the render loop can pick the variant of each
+* draw instead of branching on uniforms in the shader.
+*
+*   ShaderVariants lighting("ShadowMapping.vertexshader", "ShadowMapping.fragmentshader");
+*   lighting.onCreate = [](GLuint program) { ... uniform blocks, constant uniforms ... };
+*   GLuint program = lighting.program({ { "USE_TEXTURE", 1 }, { "USE_TRANSPARENCY", 0 } });
+*/
+class ShaderVariants {
+public:
+    ShaderVariants(const std::string& _vertexFilePath, const std::string& _fragmentFilePath);
+    ~ShaderVariants();
+
+    GLuint program(const shaderDefines& defines);
+    //Compiles the variants that aren't there yet in one batch (see loadShaderBatch)
+    void preload(const std::vector<shaderDefines>& variants);
+
+    //Called once for every new program, before it is returned
+    std::function<void(GLuint)> onCreate;
+
+    //Programs compiled so far
+    const std::vector<GLuint>& programs() const { return compiled; }
+
+private:
+    static std::string variantKey(const shaderDefines& defines);
+    void add(const std::string& key, GLuint program);
+
+    std::string vertexFilePath, fragmentFilePath;
+    std::map<std::string, GLuint> cache; //by the define lines of the variant
+    std::vector<GLuint> compiled;
+};
+
+#endif //VVR_OGL_LABORATORY_SHADERVARIANTS_H
@@ -0,0 +1,53 @@
+#include "ShadowCache.h"
+#include <stdexcept>
+
+ShadowCache::ShadowCache(int _width, int _height) : width(_width), height(_height) {
+    // Same format as the shadow map of main.cpp, glBlitFramebuffer doesn't convert depth formats
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        throw std::runtime_error("Shadow cache frame buffer not initialized correctly");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowCache::~ShadowCache() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &depthTexture);
+}
+
+bool ShadowCache::begin(const glm::mat4& lightVP, uint64_t static_signature) {
+    // Exact comparison: the light only moves with the keyboard, otherwise its matrices are rebuilt identical
+    if (valid && lightVP == cached_lightVP && static_signature == cached_signature) {
+        cache_hits++;
+        return false;
+    }
+
+    cached_lightVP = lightVP;
+    cached_signature = static_signature;
+    valid = true;
+    rebuilds++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void ShadowCache::copyTo(GLuint target) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,42 @@
+#ifndef VVR_OGL_LABORATORY_SHADOWCACHE_H
+#define VVR_OGL_LABORATORY_SHADOWCACHE_H
+#include <GL/glew.h>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/**
+* Depth of the static shadow casters, kept between frames. It is drawn again only when the light's
+* view-projection matrix or the static casters (their signature, see RenderQueue::signature) change.
+* Every frame the cached depth is copied into the shadow map and only the dynamic casters are drawn on top.
+*
+*   if (cache.begin(light->lightVP(), queue.signature(STATIC_DEPTH_PASS))) queue.flush(STATIC_DEPTH_PASS);
+*   cache.copyTo(depthFrameBuffer);
+*   queue.flush(DEPTH_PASS);
+*/
+class ShadowCache {
+public:
+    //Same size as the shadow map, the copy is a 1:1 blit
+    ShadowCache(int _width, int _height);
+    ~ShadowCache();
+
+    //Returns true when the static casters must be drawn again, the cache framebuffer is then bound and cleared
+    bool begin(const glm::mat4& lightVP, uint64_t static_signature);
+    //Copies the cached depth into the shadow map framebuffer and leaves that one bound
+    void copyTo(GLuint target);
+    //The next begin draws the static casters again
+    void invalidate() { valid = false; }
+
+    int cache_hits = 0; //frames that were served from the cache
+    int rebuilds = 0;   //frames that drew the static casters
+
+private:
+    int width, height;
+    GLuint framebuffer = 0;
+    GLuint depthTexture = 0;
+
+    bool valid = false;
+    glm::mat4 cached_lightVP;
+    uint64_t cached_signature = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_SHADOWCACHE_H
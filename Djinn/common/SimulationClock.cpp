@@ -0,0 +1,35 @@
+#include "SimulationClock.h"
+#include <algorithm>
+
+void SimulationClock::beginFrame(float frame_dt) {
+    frame_substeps = 0;
+
+    if (deterministic) {
+        accumulator = fixed_dt;
+        return;
+    }
+
+    accumulator += std::max(frame_dt, 0.0f);
+
+    // A very slow frame (or a breakpoint) would otherwise need hundreds of steps to catch up
+    float max_time = max_substeps * fixed_dt;
+    if (accumulator > max_time) {
+        int dropped = (int)((accumulator - max_time) / fixed_dt);
+        dropped_steps += dropped;
+        accumulator -= dropped * fixed_dt;
+    }
+}
+
+bool SimulationClock::step() {
+    if (accumulator < fixed_dt || frame_substeps >= max_substeps) return false;
+
+    accumulator -= fixed_dt;
+    time = ++steps * fixed_dt;
+    frame_substeps++;
+    return true;
+}
+
+float SimulationClock::alpha() const {
+    if (deterministic) return 1.0f;
+    return std::min(accumulator / fixed_dt, 1.0f);
+}
@@ -0,0 +1,36 @@
+#ifndef VVR_OGL_LABORATORY_SIMULATIONCLOCK_H
+#define VVR_OGL_LABORATORY_SIMULATIONCLOCK_H
+
+/**
+* Fixed timestep clock. The frame time is added to an accumulator and the simulation
+* is advanced in steps of fixed_dt (at most max_substeps per frame). The remainder
+* gives the interpolation factor between the last two simulated states.
+*
+*   clock.beginFrame(frame_dt);
+*   while (clock.step()) simulate(clock.time, clock.fixed_dt);
+*   render(clock.alpha());
+*/
+class SimulationClock {
+public:
+    float fixed_dt = 1.0f / 60.0f;
+    int max_substeps = 5;
+
+    // Every frame advances exactly one step, no matter how long the frame took.
+    // Used for the regression benchmarks, together with the seed
+    bool deterministic = false;
+    unsigned int seed = 1;
+
+    float time = 0.0f;   // simulated time
+    int steps = 0;       // total number of simulated steps
+    int dropped_steps = 0; // steps lost because of the substep cap
+
+    void beginFrame(float frame_dt);
+    bool step();
+    float alpha() const;
+
+private:
+    float accumulator = 0.0f;
+    int frame_substeps = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_SIMULATIONCLOCK_H
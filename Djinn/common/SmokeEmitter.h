@@ -1,17 +1,12 @@
 #ifndef VVR_OGL_LABORATORY_SMOKEEMITTER_H
 #define VVR_OGL_LABORATORY_SMOKEEMITTER_H
-#include "IntParticleEmitter.h"
+#include "SmokePolicies.h"
 
-class SmokeEmitter : public IntParticleEmitter {
+// The blue smoke of the lamp, composed from the policies of SmokePolicies.h. The settings
+// (height_threshold, fluid) are in smokeSettings
+class SmokeEmitter : public PolicyEmitter<SmokeSpawn, SmokeIntegrate, NoForce, SmokeKill, SmokeRenderData, smokeSettings> {
     public:
-        SmokeEmitter(Drawable* _model, int number);
-
-        // Stop rendering the particles after position.y > 5.0f
-        float height_threshold = 5.0f;
-
-        int active_particles = 0; //number of particles that have been instantiated
-        void createNewParticle(int index) override;
-        void updateParticles(float time, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) override;
+        SmokeEmitter(int number) : PolicyEmitter(number) {}
 };
 
 #endif //VVR_OGL_LABORATORY_SMOKEEMITTER_H
\ No newline at end of file
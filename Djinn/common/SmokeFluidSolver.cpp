@@ -0,0 +1,198 @@
+#include "SmokeFluidSolver.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <iomanip>
+
+using namespace glm;
+
+SmokeFluidSolver::SmokeFluidSolver(vec3 _box_min, vec3 box_max, float cell_size)
+    : box_min(_box_min), h(cell_size) {
+    ivec3 n = max(ivec3(ceil((box_max - box_min) / h)), ivec3(2));
+    nx = n.x;
+    ny = n.y;
+    nz = n.z;
+
+    int cells = cellCount();
+    velocity.assign(cells, vec3(0.0f));
+    velocity_prev.assign(cells, vec3(0.0f));
+    density.assign(cells, 0.0f);
+    density_prev.assign(cells, 0.0f);
+    divergence.assign(cells, 0.0f);
+    pressure.assign(cells, 0.0f);
+    pressure_next.assign(cells, 0.0f);
+    solid.assign(cells, 0);
+
+    slabs.resize(nz);
+    std::iota(slabs.begin(), slabs.end(), 0);
+}
+
+vec3 SmokeFluidSolver::cellCenter(int i, int j, int k) const {
+    return box_min + (vec3(i, j, k) + 0.5f) * h;
+}
+
+template<typename F>
+void SmokeFluidSolver::forEachCell(F f) {
+    //A slab only writes its own cells, the neighbors are read from the other buffers
+    std::for_each(std::execution::par, slabs.begin(), slabs.end(), [&](int k) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                f(i, j, k);
+            }
+        }
+    });
+}
+
+bool SmokeFluidSolver::inside(vec3 p) const {
+    vec3 g = (p - box_min) / h;
+    return g.x >= 0.0f && g.y >= 0.0f && g.z >= 0.0f && g.x <= nx && g.y <= ny && g.z <= nz;
+}
+
+template<typename T>
+T SmokeFluidSolver::sample(const std::vector<T>& field, vec3 p) const {
+    //Grid coordinates with the cell centers on the integers, clamped to the outer centers
+    vec3 g = clamp((p - box_min) / h - 0.5f, vec3(0.0f), vec3(nx - 1, ny - 1, nz - 1));
+    ivec3 c0 = ivec3(g);
+    ivec3 c1 = min(c0 + 1, ivec3(nx - 1, ny - 1, nz - 1));
+    vec3 f = g - vec3(c0);
+
+    T x00 = mix(field[index(c0.x, c0.y, c0.z)], field[index(c1.x, c0.y, c0.z)], f.x);
+    T x10 = mix(field[index(c0.x, c1.y, c0.z)], field[index(c1.x, c1.y, c0.z)], f.x);
+    T x01 = mix(field[index(c0.x, c0.y, c1.z)], field[index(c1.x, c0.y, c1.z)], f.x);
+    T x11 = mix(field[index(c0.x, c1.y, c1.z)], field[index(c1.x, c1.y, c1.z)], f.x);
+    return mix(mix(x00, x10, f.y), mix(x01, x11, f.y), f.z);
+}
+
+vec3 SmokeFluidSolver::velocityAt(vec3 p) const {
+    if (!inside(p)) return vec3(0.0f);
+    return sample(velocity, p);
+}
+
+float SmokeFluidSolver::densityAt(vec3 p) const {
+    if (!inside(p)) return 0.0f;
+    return sample(density, p);
+}
+
+void SmokeFluidSolver::addForces(float dt) {
+    float wind_factor = std::min(wind_strength * dt, 1.0f);
+
+    forEachCell([&](int i, int j, int k) {
+        int c = index(i, j, k);
+        vec3 center = cellCenter(i, j, k);
+
+        solid[c] = 0;
+        for (const vec4& o : obstacles) {
+            vec3 d = center - vec3(o);
+            if (dot(d, d) < o.w * o.w) solid[c] = 1;
+        }
+
+        //Hot smoke rises, the air is slowly dragged by the wind
+        velocity[c].y += buoyancy * density[c] * dt;
+        velocity[c] += (wind - velocity[c]) * wind_factor;
+
+        vec3 d = center - source_pos;
+        if (dot(d, d) < source_radius * source_radius) {
+            density[c] = 1.0f;
+            velocity[c] = source_velocity;
+        }
+    });
+}
+
+void SmokeFluidSolver::advect(float dt) {
+    std::swap(velocity, velocity_prev);
+    std::swap(density, density_prev);
+    float fade = std::max(0.0f, 1.0f - dissipation * dt);
+
+    //Semi-Lagrangian: every cell takes what was at the point that flows into it
+    forEachCell([&](int i, int j, int k) {
+        int c = index(i, j, k);
+        vec3 back = cellCenter(i, j, k) - velocity_prev[c] * dt;
+        velocity[c] = sample(velocity_prev, back);
+        density[c] = sample(density_prev, back) * fade;
+    });
+}
+
+void SmokeFluidSolver::enforceBoundaries() {
+    //No flow through the walls, the floor and the obstacles. The top is open
+    forEachCell([&](int i, int j, int k) {
+        int c = index(i, j, k);
+        if (solid[c]) {
+            velocity[c] = vec3(0.0f);
+            return;
+        }
+        if (i == 0 || i == nx - 1) velocity[c].x = 0.0f;
+        if (j == 0) velocity[c].y = 0.0f;
+        if (k == 0 || k == nz - 1) velocity[c].z = 0.0f;
+    });
+}
+
+void SmokeFluidSolver::computeDivergence() {
+    forEachCell([&](int i, int j, int k) {
+        int c = index(i, j, k);
+        //Clamped neighbors: a wall has the velocity of the cell next to it
+        float dx = velocity[index(std::min(i + 1, nx - 1), j, k)].x - velocity[index(std::max(i - 1, 0), j, k)].x;
+        float dy = velocity[index(i, std::min(j + 1, ny - 1), k)].y - velocity[index(i, std::max(j - 1, 0), k)].y;
+        float dz = velocity[index(i, j, std::min(k + 1, nz - 1))].z - velocity[index(i, j, std::max(k - 1, 0))].z;
+        divergence[c] = -0.5f * h * (dx + dy + dz);
+    });
+}
+
+void SmokeFluidSolver::solvePressure() {
+    //The pressure of the last step is the initial guess, it changes little between steps
+    for (int iteration = 0; iteration < jacobi_iterations; iteration++) {
+        forEachCell([&](int i, int j, int k) {
+            int c = index(i, j, k);
+            if (solid[c]) {
+                pressure_next[c] = 0.0f;
+                return;
+            }
+            float p = pressure[c];
+
+            //Walls, floor and obstacles: zero pressure gradient. Above the open top: zero pressure
+            auto neighbor = [&](int ni, int nj, int nk) {
+                if (nj >= ny) return 0.0f;
+                if (ni < 0 || ni >= nx || nj < 0 || nk < 0 || nk >= nz) return p;
+                int n = index(ni, nj, nk);
+                return solid[n] ? p : pressure[n];
+            };
+
+            float sum = neighbor(i - 1, j, k) + neighbor(i + 1, j, k)
+                      + neighbor(i, j - 1, k) + neighbor(i, j + 1, k)
+                      + neighbor(i, j, k - 1) + neighbor(i, j, k + 1);
+            pressure_next[c] = (divergence[c] + sum) / 6.0f;
+        });
+        std::swap(pressure, pressure_next);
+    }
+}
+
+void SmokeFluidSolver::project() {
+    forEachCell([&](int i, int j, int k) {
+        int c = index(i, j, k);
+        if (solid[c]) return;
+        float p = pressure[c];
+
+        auto neighbor = [&](int ni, int nj, int nk) {
+            if (nj >= ny) return 0.0f;
+            if (ni < 0 || ni >= nx || nj < 0 || nk < 0 || nk >= nz) return p;
+            int n = index(ni, nj, nk);
+            return solid[n] ? p : pressure[n];
+        };
+
+        vec3 gradient(neighbor(i + 1, j, k) - neighbor(i - 1, j, k),
+                      neighbor(i, j + 1, k) - neighbor(i, j - 1, k),
+                      neighbor(i, j, k + 1) - neighbor(i, j, k - 1));
+        velocity[c] -= 0.5f * gradient / h;
+    });
+}
+
+void SmokeFluidSolver::report(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2)
+        << "fluid " << nx << "x" << ny << "x" << nz << ": step " << timings.total_ms << " ms (forces "
+        << timings.forces_ms << ", advect " << timings.advect_ms << ", divergence " << timings.divergence_ms
+        << ", pressure " << timings.pressure_ms << " / " << jacobi_iterations << " iterations, project "
+        << timings.project_ms << ")" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
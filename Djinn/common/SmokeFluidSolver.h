@@ -0,0 +1,134 @@
+#ifndef VVR_OGL_LABORATORY_SMOKEFLUIDSOLVER_H
+#define VVR_OGL_LABORATORY_SMOKEFLUIDSOLVER_H
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <glm/glm.hpp>
+
+//Time (ms) of the stages of the last step
+struct fluidTimings {
+    float forces_ms = 0.0f;
+    float advect_ms = 0.0f;
+    float divergence_ms = 0.0f;
+    float pressure_ms = 0.0f;
+    float project_ms = 0.0f;
+    float total_ms = 0.0f;
+};
+
+/**
+* Stable fluids (Stam) on a bounded box of cubic cells, with the velocity and the smoke density at the
+* cell centers. A step adds the source, the buoyancy and the wind, advects velocity and density
+* semi-Lagrangian and projects the velocity to be divergence free with Jacobi iterations.
+* Every stage runs in parallel over the z slabs of the grid. It doesn't use GL.
+*
+* The box is closed except for the top, where the smoke leaves. Spheres in obstacles are solid.
+*
+*   SmokeFluidSolver fluid(glm::vec3(-3, -1, -3), glm::vec3(7, 6, 3), 0.25f);
+*   fluid.source_pos = smoke_emitter_pos;
+*   fluid.step(dt);
+*   particle.position += fluid.velocityAt(particle.position) * dt;
+*/
+class SmokeFluidSolver {
+public:
+    SmokeFluidSolver(glm::vec3 box_min, glm::vec3 box_max, float cell_size);
+
+    //Inflow of smoke (density 1, source_velocity) in a sphere
+    glm::vec3 source_pos = glm::vec3(0.0f);
+    float source_radius = 0.3f;
+    glm::vec3 source_velocity = glm::vec3(0.0f, 3.0f, 0.0f);
+
+    float buoyancy = 2.0f;             //upward acceleration per unit of density
+    glm::vec3 wind = glm::vec3(0.0f);  //velocity the air is pulled towards
+    float wind_strength = 0.5f;        //1/s, how fast the air follows the wind
+    float dissipation = 0.3f;          //1/s, fading of the density
+    int jacobi_iterations = 30;
+
+    //Solid spheres (center, radius), for example the Djinn, voxelized at every step
+    std::vector<glm::vec4> obstacles;
+
+    fluidTimings timings;
+
+    struct noStageScope {
+        noStageScope(const char* name) {}
+    };
+
+    //Every stage runs inside a Scope made from its name. The solver doesn't depend on GL, the demo
+    //passes ProfileScope to see the stages in the profiler
+    template<class Scope = noStageScope>
+    void step(float dt) {
+        stageTimer total(timings.total_ms);
+        {
+            Scope scope("forces");
+            stageTimer timer(timings.forces_ms);
+            addForces(dt);
+        }
+        {
+            Scope scope("advect");
+            stageTimer timer(timings.advect_ms);
+            advect(dt);
+            enforceBoundaries();
+        }
+        {
+            Scope scope("divergence");
+            stageTimer timer(timings.divergence_ms);
+            computeDivergence();
+        }
+        {
+            Scope scope("pressure");
+            stageTimer timer(timings.pressure_ms);
+            solvePressure();
+        }
+        {
+            Scope scope("project");
+            stageTimer timer(timings.project_ms);
+            project();
+            enforceBoundaries();
+        }
+    }
+
+    //Trilinear sample, zero outside the box
+    glm::vec3 velocityAt(glm::vec3 p) const;
+    float densityAt(glm::vec3 p) const;
+    bool inside(glm::vec3 p) const;
+
+    glm::ivec3 resolution() const { return glm::ivec3(nx, ny, nz); }
+    int cellCount() const { return nx * ny * nz; }
+    //Prints the timings of the last step on one line
+    void report(std::ostream& out) const;
+
+private:
+    //Writes the time (ms) from its construction to the end of its scope
+    struct stageTimer {
+        float& ms;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stageTimer(float& _ms) : ms(_ms) {}
+        ~stageTimer() { ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+    };
+
+    glm::vec3 box_min;
+    float h; //cell size
+    int nx, ny, nz;
+
+    std::vector<glm::vec3> velocity, velocity_prev;
+    std::vector<float> density, density_prev;
+    std::vector<float> divergence, pressure, pressure_next;
+    std::vector<char> solid;
+    std::vector<int> slabs; //0 .. nz - 1, what the parallel loops run over
+
+    int index(int i, int j, int k) const { return i + nx * (j + ny * k); }
+    glm::vec3 cellCenter(int i, int j, int k) const;
+
+    //Calls f(i, j, k) for every cell, the slabs in parallel
+    template<typename F> void forEachCell(F f);
+
+    template<typename T> T sample(const std::vector<T>& field, glm::vec3 p) const;
+
+    void addForces(float dt);
+    void advect(float dt);
+    void computeDivergence();
+    void solvePressure();
+    void project();
+    void enforceBoundaries();
+};
+
+#endif //VVR_OGL_LABORATORY_SMOKEFLUIDSOLVER_H
@@ -0,0 +1,108 @@
+#ifndef VVR_OGL_LABORATORY_SMOKEPOLICIES_H
+#define VVR_OGL_LABORATORY_SMOKEPOLICIES_H
+#include <algorithm>
+#include "PolicyEmitter.h"
+#include "SmokeFluidSolver.h"
+
+// The blue smoke as PolicyEmitter policies, SmokeEmitter is composed from them
+
+// Bézier curve through 4 control points as numVertices points, and the position at t along it
+std::vector<glm::vec3> generateCurve(int numVertices, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
+glm::vec3 bezier_position(float t, const std::vector<glm::vec3>& control_points);
+
+// Growth of a smoke particle in one update, without branches: +0.015 while life is in (0.7, 1],
+// +0.05 in (0.3, 0.7), +0.1 below 0.3 and never more than 0.7
+inline float smokeMassStep(float life, float mass) {
+    float rate = 0.015f * ((life > 0.7f) & (life <= 1.0f))
+               + 0.05f * ((life > 0.3f) & (life < 0.7f))
+               + 0.1f * (life < 0.3f);
+    return std::min(mass + rate, 0.7f);
+}
+
+struct smokeSettings {
+    // Stop rendering the particles after position.y > 5.0f
+    float height_threshold = 5.0f;
+
+    // When set (not owned), the particles are carried by the velocity of the solver
+    // instead of following their Bézier curve. The solver is stepped by its owner
+    SmokeFluidSolver* fluid = nullptr;
+};
+
+struct SmokeSpawn : RampSpawn {
+    template<class Emitter>
+    void create(Emitter& e, particleAttributes& particle) {
+        particle.velocity = glm::vec3(1,1,1);
+
+        // Start the mass of the particles at a small size
+        particle.mass = 0.02f;
+        particle.rot_axis = glm::normalize(glm::vec3(1 - 2*e.randomFloat(), 1 - 2*e.randomFloat(), 1 - 2*e.randomFloat()));
+        particle.accel = glm::vec3(1,1,1);
+        particle.rot_angle = e.randomFloat()*360;
+        particle.life = 1.0f; //mark it alive
+        particle.t = 0;
+
+        if (e.fluid != nullptr) {
+            // Somewhere in the source of the solver, the curve isn't needed
+            glm::vec3 offset(e.randomFloat() - 0.5f, e.randomFloat() - 0.5f, e.randomFloat() - 0.5f);
+            particle.position = e.emitter_pos + offset * e.fluid->source_radius;
+            particle.control_points.clear();
+            return;
+        }
+
+        // Control points of the bezier curve of the particle
+        particle.p0 = e.emitter_pos;
+        particle.p1 = glm::vec3(0.5f * (e.randomFloat() - e.randomFloat()), 2.0f + 0.7f * (e.randomFloat() - e.randomFloat()), 0.5f * (e.randomFloat() - e.randomFloat()));
+        particle.p2 = glm::vec3(5.0f + 2.5 * (e.randomFloat() - e.randomFloat()), 2.0f + 0.5f * (e.randomFloat() - e.randomFloat()), 2.5 * (e.randomFloat() - e.randomFloat()));
+        particle.p3 = glm::vec3(5.0f + 2.0 * (e.randomFloat() - e.randomFloat()), 5.0f, 2.0 * (e.randomFloat() - e.randomFloat()));
+
+        particle.control_points = generateCurve(10, particle.p0, particle.p1, particle.p2, particle.p3);
+        particle.position = e.emitter_pos + bezier_position(particle.t, particle.control_points);
+    }
+};
+
+// Carried by the air of the solver, or along the curve with every particle of an update a bit
+// faster than the previous one
+struct SmokeIntegrate {
+    float counter = 0.0f;
+
+    void begin() {
+        counter = 0.0f;
+    }
+
+    template<class Emitter>
+    void integrate(Emitter& e, particleAttributes& particle, float dt) {
+        if (e.fluid != nullptr) {
+            particle.position += e.fluid->velocityAt(particle.position) * dt;
+            return;
+        }
+
+        counter += 0.01f;
+        particle.t += dt * counter;
+        counter = std::min(counter, 4.8f);
+
+        particle.position = bezier_position(particle.t, particle.control_points) + particle.velocity * dt + particle.accel * (dt * dt);
+        particle.velocity = particle.velocity + particle.accel * dt;
+    }
+};
+
+// Above the height threshold, or out of the box of the solver
+struct SmokeKill {
+    template<class Emitter>
+    bool dead(const Emitter& e, const particleAttributes& particle) const {
+        bool left_fluid = e.fluid != nullptr && !e.fluid->inside(particle.position);
+        return particle.position.y > e.height_threshold || left_fluid;
+    }
+};
+
+// Life from the height the puff reached, the mass (scale) grows with it
+struct SmokeRenderData : CameraRenderData {
+    template<bool billboards, class Emitter>
+    void write(Emitter& e, particleAttributes& particle, glm::vec3 camera_pos) {
+        CameraRenderData::write<billboards>(e, particle, camera_pos);
+
+        particle.life = (e.height_threshold - particle.position.y) / (e.height_threshold - e.emitter_pos.y);
+        particle.mass = smokeMassStep(particle.life, particle.mass);
+    }
+};
+
+#endif //VVR_OGL_LABORATORY_SMOKEPOLICIES_H
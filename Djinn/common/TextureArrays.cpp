@@ -0,0 +1,163 @@
+#include "TextureArrays.h"
+#include "texture.h"
+#include "CookedTexture.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include "TextureManager.h"
+#include <SOIL.h>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <execution>
+
+TextureArrays::~TextureArrays() {
+    if (!arrays.empty()) glDeleteTextures(arrays.size(), &arrays[0]);
+    TextureManager::instance().removeFixedBytes(gpu_bytes);
+}
+
+//Every level and layer of the bound GL_TEXTURE_2D_ARRAY
+static size_t arrayBytes() {
+    size_t bytes = 0;
+    for (int level = 0; ; level++) {
+        GLint width = 0, height = 0, depth = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_DEPTH, &depth);
+        if (width == 0 || height == 0) break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += size;
+        }
+        else {
+            //The drivers keep RGB8 as 4 bytes per texel
+            bytes += (size_t) width * height * depth * 4;
+        }
+    }
+    return bytes;
+}
+
+int TextureArrays::add(const std::string& imagePath) {
+    if (imagePath.empty()) return -1;
+    auto handle = handles.find(imagePath);
+    if (handle != handles.end()) return handle->second;
+
+    paths.push_back(imagePath);
+    handles[imagePath] = paths.size() - 1;
+    return paths.size() - 1;
+}
+
+textureLayer TextureArrays::layer(int handle) const {
+    if (handle < 0 || handle >= layers.size()) return textureLayer();
+    return layers[handle];
+}
+
+void TextureArrays::build() {
+    ProfileScope scope("texture arrays");
+    //One image in memory until its array exists: the mapped .dtex or the decoded pixels
+    struct source {
+        std::unique_ptr<MappedFile> cooked;
+        unsigned char* pixels = nullptr;
+        std::string error;
+        arrayKey key;
+    };
+    std::vector<source> sources(paths.size());
+    std::vector<int> order(paths.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+
+    //The cooked images are mapped at the same time. SOIL isn't reentrant, so the other images are
+    //decoded one at a time (decodeImageRGB locks), while the cooked ones are still being read
+    std::for_each(std::execution::par, order.begin(), order.end(), [&](int i) {
+        ProfileScope scope("decode " + paths[i]);
+        source& s = sources[i];
+        std::string cooked = cookedTexturePath(paths[i].c_str());
+        if (!cooked.empty()) {
+            s.cooked.reset(new MappedFile(cooked.c_str()));
+            const cookedTextureHeader* header = cookedHeader(s.cooked->data, s.cooked->size);
+            if (header && cookedTextureFormat(header->format)) {
+                s.key = { (int) header->width, (int) header->height, cookedTextureFormat(header->format) };
+            }
+        }
+        else {
+            s.pixels = decodeImageRGB(paths[i].c_str(), s.key.width, s.key.height, s.error);
+            s.key.format = GL_RGB8;
+        }
+    });
+
+    for (int i = 0; i < sources.size(); i++) {
+        const source& s = sources[i];
+        if (s.cooked && s.key.format == 0) {
+            throw std::runtime_error("Not a correct cooked texture: " + cookedTexturePath(paths[i].c_str()));
+        }
+        if (!s.cooked && !s.pixels) {
+            throw std::runtime_error("Failed to load texture: " + paths[i] + ": " + s.error);
+        }
+        std::cout << (s.cooked ? "Reading cooked texture: " : "Reading image: ") << paths[i] << std::endl;
+    }
+
+    //The layers of every array, in the order of the handles
+    std::map<arrayKey, std::vector<int>> groups;
+    for (int i = 0; i < sources.size(); i++) {
+        groups[sources[i].key].push_back(i);
+    }
+
+    layers.assign(paths.size(), textureLayer());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const auto& group : groups) {
+        const arrayKey& key = group.first;
+        const std::vector<int>& members = group.second;
+        GLsizei count = members.size();
+
+        GLuint array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        arrays.push_back(array);
+
+        if (key.format == GL_RGB8) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, key.width, key.height, count, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            for (int l = 0; l < count; l++) {
+                source& s = sources[members[l]];
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, key.width, key.height, 1, GL_RGB, GL_UNSIGNED_BYTE, s.pixels);
+                SOIL_free_image_data(s.pixels);
+                s.pixels = nullptr;
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        else {
+            //Same size and format, so the same mip chain: allocate every level, then fill the layers
+            unsigned int mip_count = ((const cookedTextureHeader*) sources[members[0]].cooked->data)->mip_count;
+            const cookedMip* mips = cookedMips(sources[members[0]].cooked->data);
+            for (unsigned int level = 0; level < mip_count; level++) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, key.format, mips[level].width, mips[level].height,
+                                       count, 0, mips[level].size * count, NULL);
+            }
+            for (int l = 0; l < count; l++) {
+                source& s = sources[members[l]];
+                const cookedMip* layer_mips = cookedMips(s.cooked->data);
+                for (unsigned int level = 0; level < mip_count; level++) {
+                    const cookedMip& mip = layer_mips[level];
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, l, mip.width, mip.height, 1,
+                                              key.format, mip.size, s.cooked->data + mip.offset);
+                }
+                s.cooked.reset();
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        for (int l = 0; l < count; l++) {
+            layers[members[l]] = { array, l };
+        }
+        gpu_bytes += arrayBytes();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    TextureManager::instance().addFixedBytes(gpu_bytes);
+
+    std::cout << "Texture arrays: " << paths.size() << " maps in " << arrays.size() << " arrays" << std::endl;
+}
@@ -0,0 +1,58 @@
+#ifndef VVR_OGL_LABORATORY_TEXTUREARRAYS_H
+#define VVR_OGL_LABORATORY_TEXTUREARRAYS_H
+#include <GL/glew.h>
+#include <vector>
+#include <map>
+#include <string>
+
+//Where a map ended up: a GL_TEXTURE_2D_ARRAY and the layer in it. A layer of -1 is no map
+struct textureLayer {
+    GLuint array = 0;
+    int layer = -1;
+};
+
+/**
+* Packs the maps of the materials into GL_TEXTURE_2D_ARRAYs, one array for every size (and format),
+* so that materials with same-sized maps bind the same arrays and only their layers change.
+* The maps are added while loading, and the arrays are created all at once by build(). A cooked
+* image (.dtex, texcook) keeps its compressed mips, the others are decoded and get generated mips.
+*
+*   TextureArrays maps;
+*   int albedo = maps.add("Textures/table/albedo.png");
+*   maps.build();
+*   material.albedo = maps.layer(albedo);
+*/
+class TextureArrays {
+public:
+    ~TextureArrays();
+
+    //Handle of the image, -1 for an empty path. The same path is added once
+    int add(const std::string& imagePath);
+    void build();
+
+    textureLayer layer(int handle) const;
+    int arrayCount() const { return arrays.size(); }
+    int layerCount() const { return paths.size(); }
+    //GPU memory of the arrays, it counts against the budget of the TextureManager
+    size_t gpuBytes() const { return gpu_bytes; }
+
+private:
+    //Maps that can share an array
+    struct arrayKey {
+        int width = 0, height = 0;
+        GLenum format = 0;  //GL_RGB8 for the decoded images, the compressed format for the cooked ones
+        bool operator<(const arrayKey& o) const {
+            if (width != o.width) return width < o.width;
+            if (height != o.height) return height < o.height;
+            return format < o.format;
+        }
+    };
+
+    std::vector<std::string> paths;
+    std::map<std::string, int> handles;
+    std::vector<textureLayer> layers;
+    std::vector<GLuint> arrays;
+    size_t gpu_bytes = 0;
+};
+
+#endif //VVR_OGL_LABORATORY_TEXTUREARRAYS_H
@@ -0,0 +1,200 @@
+#include "TextureCooker.h"
+#include <algorithm>
+#include <execution>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+
+//Colors of the BC1 end points
+static uint16_t to565(const int c[3]) {
+    int r = (c[0] * 31 + 127) / 255;
+    int g = (c[1] * 63 + 127) / 255;
+    int b = (c[2] * 31 + 127) / 255;
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void from565(uint16_t color, int c[3]) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeColor(const uint8_t texels[64], uint8_t out[8]) {
+    //Bounding box of the colors, inset by 1/16 so that the end points aren't spent on outliers
+    int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            low[c] = std::min(low[c], (int) texels[4 * i + c]);
+            high[c] = std::max(high[c], (int) texels[4 * i + c]);
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        int inset = (high[c] - low[c]) / 16;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+
+    uint16_t color0 = to565(high), color1 = to565(low);
+    if (color0 < color1) std::swap(color0, color1);
+    out[0] = color0 & 0xff;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xff;
+    out[3] = color1 >> 8;
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        //color0 > color1 is the 4 color mode: the end points and two thirds between them
+        int palette[4][3];
+        from565(color0, palette[0]);
+        from565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, best_distance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = texels[4 * i + c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+    for (int b = 0; b < 4; b++) out[4 + b] = (indices >> (8 * b)) & 0xff;
+}
+
+//One channel (the alpha of BC3, each half of BC5): 8 values between the end points
+static void encodeChannel(const uint8_t texels[64], int channel, uint8_t out[8]) {
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = std::min(low, (int) texels[4 * i + channel]);
+        high = std::max(high, (int) texels[4 * i + channel]);
+    }
+    out[0] = (uint8_t) high;
+    out[1] = (uint8_t) low;
+
+    uint64_t indices = 0;
+    if (high != low) {
+        //value0 > value1: index 0 and 1 are the end points, 2..7 are 1/7..6/7 of the way to value1
+        int palette[8] = { high, low };
+        for (int k = 1; k < 7; k++) palette[k + 1] = ((7 - k) * high + k * low) / 7;
+        for (int i = 0; i < 16; i++) {
+            int value = texels[4 * i + channel];
+            int best = 0;
+            for (int p = 1; p < 8; p++) {
+                if (std::abs(value - palette[p]) < std::abs(value - palette[best])) best = p;
+            }
+            indices |= (uint64_t) best << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; b++) out[2 + b] = (indices >> (8 * b)) & 0xff;
+}
+
+void encodeBC1Block(const uint8_t texels[64], uint8_t out[8]) {
+    encodeColor(texels, out);
+}
+
+void encodeBC3Block(const uint8_t texels[64], uint8_t out[16]) {
+    encodeChannel(texels, 3, out);
+    encodeColor(texels, out + 8);
+}
+
+void encodeBC5Block(const uint8_t texels[64], uint8_t out[16]) {
+    encodeChannel(texels, 0, out);
+    encodeChannel(texels, 1, out + 8);
+}
+
+std::vector<uint8_t> downsampleRGBA(const std::vector<uint8_t>& rgba, int width, int height) {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<uint8_t> result(w * h * 4);
+    for (int y = 0; y < h; y++) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < w; x++) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; c++) {
+                int sum = rgba[4 * (y0 * width + x0) + c] + rgba[4 * (y0 * width + x1) + c] +
+                          rgba[4 * (y1 * width + x0) + c] + rgba[4 * (y1 * width + x1) + c];
+                result[4 * (y * w + x) + c] = (uint8_t) ((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+static cookedLevel compressLevel(const std::vector<uint8_t>& rgba, int width, int height, cookedFormat format) {
+    cookedLevel level;
+    level.width = width;
+    level.height = height;
+    level.blocks.resize(cookedMipSize(format, width, height));
+
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    uint32_t block_bytes = cookedBlockBytes(format);
+    std::vector<int> rows(blocks_y);
+    for (int i = 0; i < blocks_y; i++) rows[i] = i;
+
+    //Every row of blocks on its own thread
+    std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int by) {
+        uint8_t texels[64];
+        for (int bx = 0; bx < blocks_x; bx++) {
+            //The blocks on the right and bottom edges repeat the last texels
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(4 * bx + i % 4, width - 1);
+                int y = std::min(4 * by + i / 4, height - 1);
+                std::copy_n(&rgba[4 * (y * width + x)], 4, &texels[4 * i]);
+            }
+            uint8_t* out = &level.blocks[(by * blocks_x + bx) * block_bytes];
+            switch (format) {
+                case COOKED_BC1: encodeBC1Block(texels, out); break;
+                case COOKED_BC3: encodeBC3Block(texels, out); break;
+                case COOKED_BC5: encodeBC5Block(texels, out); break;
+            }
+        }
+    });
+    return level;
+}
+
+std::vector<cookedLevel> cookTexture(const uint8_t* rgba, int width, int height, cookedFormat format) {
+    std::vector<cookedLevel> mips;
+    std::vector<uint8_t> level(rgba, rgba + width * height * 4);
+    while (true) {
+        mips.push_back(compressLevel(level, width, height, format));
+        if (width == 1 && height == 1) break;
+        level = downsampleRGBA(level, width, height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return mips;
+}
+
+void writeCookedTexture(const std::string& path, cookedFormat format, const std::vector<cookedLevel>& mips) {
+    cookedTextureHeader header;
+    header.format = format;
+    header.width = mips.empty() ? 0 : mips[0].width;
+    header.height = mips.empty() ? 0 : mips[0].height;
+    header.mip_count = mips.size();
+
+    std::vector<cookedMip> table(mips.size());
+    uint32_t offset = sizeof(cookedTextureHeader) + mips.size() * sizeof(cookedMip);
+    for (int i = 0; i < mips.size(); i++) {
+        table[i] = { mips[i].width, mips[i].height, offset, (uint32_t) mips[i].blocks.size() };
+        offset += mips[i].blocks.size();
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can't write cooked texture: " + path);
+    }
+    file.write((const char*) &header, sizeof(header));
+    file.write((const char*) table.data(), table.size() * sizeof(cookedMip));
+    for (const cookedLevel& mip : mips) {
+        file.write((const char*) mip.blocks.data(), mip.blocks.size());
+    }
+}
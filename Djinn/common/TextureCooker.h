@@ -0,0 +1,37 @@
+#ifndef VVR_OGL_LABORATORY_TEXTURECOOKER_H
+#define VVR_OGL_LABORATORY_TEXTURECOOKER_H
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "CookedTexture.h"
+
+//One level of the mip chain, blocks are in rows from the top left
+struct cookedLevel {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> blocks;
+};
+
+/**
+* The offline half of the cooked textures (texcook): a box filtered mip chain down to 1x1 and
+* the block compression of every level, with the blocks of a level encoded in parallel.
+* No GL, the encoders are a plain bounding box fit, good enough for the albedo/roughness maps.
+*
+*   std::vector<cookedLevel> mips = cookTexture(rgba, width, height, COOKED_BC1);
+*   writeCookedTexture("albedo.dtex", COOKED_BC1, mips);
+*/
+//rgba: width * height texels of 4 bytes
+std::vector<cookedLevel> cookTexture(const uint8_t* rgba, int width, int height, cookedFormat format);
+
+//Throws when the file can't be written
+void writeCookedTexture(const std::string& path, cookedFormat format, const std::vector<cookedLevel>& mips);
+
+//Half the size (at least 1), every texel the average of 2x2, edges clamped
+std::vector<uint8_t> downsampleRGBA(const std::vector<uint8_t>& rgba, int width, int height);
+
+//The blocks of 4x4 texels, 4 bytes each
+void encodeBC1Block(const uint8_t texels[64], uint8_t out[8]);
+void encodeBC3Block(const uint8_t texels[64], uint8_t out[16]);
+void encodeBC5Block(const uint8_t texels[64], uint8_t out[16]);
+
+#endif //VVR_OGL_LABORATORY_TEXTURECOOKER_H
@@ -0,0 +1,222 @@
+#include "TextureManager.h"
+#include "texture.h"
+#include "MappedFile.h"
+#include "TextureStreamer.h"
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+TextureHandle::TextureHandle(TextureManager* _manager, int _entry) : manager(_manager), entry(_entry) {
+    manager->addRef(entry);
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other) : manager(other.manager), entry(other.entry) {
+    if (entry >= 0) manager->addRef(entry);
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) : manager(other.manager), entry(other.entry) {
+    other.entry = -1;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle other) {
+    std::swap(manager, other.manager);
+    std::swap(entry, other.entry);
+    return *this;
+}
+
+TextureHandle::~TextureHandle() {
+    if (entry >= 0) manager->release(entry);
+}
+
+GLuint TextureHandle::texture() const {
+    return entry >= 0 ? manager->use(entry) : 0;
+}
+
+TextureManager& TextureManager::instance() {
+    static TextureManager manager;
+    return manager;
+}
+
+//FNV-1a of the whole file
+static uint64_t hashFile(const std::string& path) {
+    MappedFile file(path.c_str());
+    //Without this every missing file would have the same hash and share the first one's entry
+    if (!file.data) throw std::runtime_error("Can't read the texture: " + path);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < file.size; i++) {
+        hash ^= file.data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//Every level of the bound GL_TEXTURE_2D
+static size_t textureBytes(GLuint texture) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    size_t bytes = 0;
+    for (int level = 0; ; level++) {
+        GLint width = 0, height = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0) break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += size;
+        }
+        else {
+            //The drivers keep RGB8 as 4 bytes per texel
+            bytes += (size_t) width * height * 4;
+        }
+    }
+    return bytes;
+}
+
+TextureHandle TextureManager::acquire(const std::string& imagePath) {
+    if (imagePath.empty()) return TextureHandle();
+
+    std::error_code error;
+    std::string path = std::filesystem::weakly_canonical(imagePath, error).string();
+    if (error) path = imagePath;
+
+    auto known = by_path.find(path);
+    if (known != by_path.end()) {
+        manager_stats.shared++;
+        return TextureHandle(this, known->second);
+    }
+
+    //Another path with the same image. Only the cooked texture may have been shipped, then that is the content
+    std::string content_path = path;
+    if (!std::filesystem::exists(path, error)) {
+        std::string cooked = cookedTexturePath(path.c_str());
+        if (!cooked.empty()) content_path = cooked;
+    }
+    uint64_t content_hash = hashFile(content_path);
+    auto same = by_content.find(content_hash);
+    if (same != by_content.end()) {
+        manager_stats.shared++;
+        by_path[path] = same->second;
+        return TextureHandle(this, same->second);
+    }
+
+    int entry;
+    if (!free_entries.empty()) {
+        entry = free_entries.back();
+        free_entries.pop_back();
+    }
+    else {
+        entry = entries.size();
+        entries.emplace_back();
+    }
+    textureEntry& e = entries[entry];
+    e = textureEntry();
+    e.path = path;
+    e.content_hash = content_hash;
+    by_path[path] = entry;
+    by_content[content_hash] = entry;
+
+    load(entry);
+    return TextureHandle(this, entry);
+}
+
+void TextureManager::addRef(int entry) {
+    if (entries[entry].refs++ == 0) manager_stats.textures++;
+}
+
+void TextureManager::release(int entry) {
+    textureEntry& e = entries[entry];
+    if (--e.refs > 0) return;
+
+    manager_stats.textures--;
+    unload(entry);
+    by_content.erase(e.content_hash);
+    for (auto p = by_path.begin(); p != by_path.end(); ) {
+        if (p->second == entry) p = by_path.erase(p);
+        else ++p;
+    }
+    free_entries.push_back(entry);
+}
+
+GLuint TextureManager::use(int entry) {
+    textureEntry& e = entries[entry];
+    e.last_used = frame;
+    if (e.texture == 0) load(entry);
+    return e.texture;
+}
+
+void TextureManager::load(int entry) {
+    textureEntry& e = entries[entry];
+    e.texture = streamer ? streamer->request(e.path) : loadTexture(e.path.c_str());
+    if (!e.texture) throw std::runtime_error("Failed to load texture: " + e.path);
+    e.bytes = textureBytes(e.texture);
+    e.last_used = frame;
+
+    manager_stats.loads++;
+    manager_stats.resident++;
+    manager_stats.gpu_bytes += e.bytes;
+    enforceBudget(entry);
+}
+
+void TextureManager::unload(int entry) {
+    textureEntry& e = entries[entry];
+    if (e.texture == 0) return;
+    if (streamer) streamer->cancel(e.texture);
+    glDeleteTextures(1, &e.texture);
+    e.texture = 0;
+    manager_stats.resident--;
+    manager_stats.gpu_bytes -= e.bytes;
+}
+
+void TextureManager::enforceBudget(int keep) {
+    while (budget_bytes > 0 && manager_stats.gpu_bytes + manager_stats.fixed_bytes > budget_bytes) {
+        //Least recently used, and not in this frame: that one would only be loaded again
+        int victim = -1;
+        for (int i = 0; i < entries.size(); i++) {
+            const textureEntry& e = entries[i];
+            if (i == keep || e.texture == 0 || e.last_used >= frame) continue;
+            if (victim < 0 || e.last_used < entries[victim].last_used) victim = i;
+        }
+        if (victim < 0) return; // everything resident is needed by this frame
+        unload(victim);
+        manager_stats.evictions++;
+    }
+}
+
+void TextureManager::setBudget(size_t bytes) {
+    budget_bytes = bytes;
+    enforceBudget(-1);
+}
+
+void TextureManager::addFixedBytes(size_t bytes) {
+    manager_stats.fixed_bytes += bytes;
+    enforceBudget(-1);
+}
+
+void TextureManager::removeFixedBytes(size_t bytes) {
+    manager_stats.fixed_bytes -= std::min(bytes, manager_stats.fixed_bytes);
+}
+
+void TextureManager::setStreamer(TextureStreamer* _streamer) {
+    streamer = _streamer;
+    if (!streamer) return;
+
+    // The placeholder is replaced, the texture is bigger now
+    streamer->onUploaded = [this](GLuint texture) {
+        for (int i = 0; i < entries.size(); i++) {
+            textureEntry& e = entries[i];
+            if (e.texture != texture) continue;
+            manager_stats.gpu_bytes -= e.bytes;
+            e.bytes = textureBytes(texture);
+            manager_stats.gpu_bytes += e.bytes;
+            enforceBudget(i);
+            return;
+        }
+    };
+}
+
+void TextureManager::clear() {
+    for (int i = 0; i < entries.size(); i++) {
+        unload(i);
+    }
+}
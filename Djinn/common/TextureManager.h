@@ -0,0 +1,111 @@
+#ifndef VVR_OGL_LABORATORY_TEXTUREMANAGER_H
+#define VVR_OGL_LABORATORY_TEXTUREMANAGER_H
+#include <GL/glew.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class TextureManager;
+class TextureStreamer;
+
+//A shared reference to a texture of the TextureManager. Copies share it, the texture is
+//deleted when the last one goes away
+class TextureHandle {
+public:
+    TextureHandle() {}
+    TextureHandle(const TextureHandle& other);
+    TextureHandle(TextureHandle&& other);
+    TextureHandle& operator=(TextureHandle other);
+    ~TextureHandle();
+
+    //The GL texture, loaded again if the budget evicted it. It counts as used in this frame
+    GLuint texture() const;
+    explicit operator bool() const { return entry >= 0; }
+
+private:
+    friend class TextureManager;
+    TextureHandle(TextureManager* manager, int entry);
+    TextureManager* manager = nullptr;
+    int entry = -1;
+};
+
+struct textureManagerStats {
+    int textures = 0;       //referenced by a handle
+    int resident = 0;       //on the GPU right now
+    size_t gpu_bytes = 0;
+    size_t fixed_bytes = 0; //textures outside the manager that count against the budget
+    int loads = 0;          //including the reloads after an eviction
+    int evictions = 0;
+    int shared = 0;         //acquires that found the path or the same content already there
+};
+
+/**
+* The textures of the whole program, keyed by canonical path and by the hash of the file, so an
+* image that is asked for twice (or copied under another name) is loaded once. Textures are
+* reference counted through TextureHandle and their GPU size is tracked. With a budget, the least
+* recently used textures that weren't used in the current frame are deleted when the budget is
+* exceeded, and loaded again (loadTexture, or the TextureStreamer) the next time their handle asks for them.
+* The texture arrays of the materials aren't managed, but their bytes are added as fixed bytes and
+* count against the same budget.
+*
+*   TextureHandle albedo = TextureManager::instance().acquire("Textures/gold/1/albedo.png");
+*   glBindTexture(GL_TEXTURE_2D, albedo.texture());
+*/
+class TextureManager {
+public:
+    static TextureManager& instance();
+
+    //An empty handle for an empty path. Throws runtime_error when neither the image nor its cooked
+    //texture can be read
+    TextureHandle acquire(const std::string& imagePath);
+
+    //Bytes the resident textures may use, 0 for no limit. Evicts right away when it is lowered
+    void setBudget(size_t bytes);
+    //Textures that aren't managed and can't be evicted (the TextureArrays of the materials). They
+    //count against the budget, so the managed textures are evicted sooner
+    void addFixedBytes(size_t bytes);
+    void removeFixedBytes(size_t bytes);
+    size_t budget() const { return budget_bytes; }
+    //Textures used from now on belong to the new frame and aren't evicted in it
+    void beginFrame() { frame++; }
+    //Deletes every texture, before the GL context goes away. Handles that are left load again on use
+    void clear();
+    //Loads (and reloads) through the streamer: the handles get a placeholder until the image is in
+    void setStreamer(TextureStreamer* streamer);
+
+    const textureManagerStats& stats() const { return manager_stats; }
+
+private:
+    friend class TextureHandle;
+
+    struct textureEntry {
+        std::string path;
+        uint64_t content_hash = 0;
+        GLuint texture = 0;
+        size_t bytes = 0;
+        int refs = 0;
+        uint64_t last_used = 0;
+    };
+
+    std::vector<textureEntry> entries;
+    std::vector<int> free_entries;
+    std::map<std::string, int> by_path;
+    std::map<uint64_t, int> by_content;
+    size_t budget_bytes = 0;
+    TextureStreamer* streamer = nullptr;
+    uint64_t frame = 1;
+    textureManagerStats manager_stats;
+
+    TextureManager() {}
+    void addRef(int entry);
+    void release(int entry);
+    GLuint use(int entry);
+    void load(int entry);
+    void unload(int entry);
+    //Evicts until the resident textures fit the budget, never the one that is kept
+    void enforceBudget(int keep);
+};
+
+#endif //VVR_OGL_LABORATORY_TEXTUREMANAGER_H
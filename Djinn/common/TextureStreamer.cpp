@@ -0,0 +1,229 @@
+#include "TextureStreamer.h"
+#include "texture.h"
+#include "Profiler.h"
+#include <SOIL.h>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+TextureStreamer::TextureStreamer(int threads) {
+    if (threads <= 0) threads = std::max(1, (int) std::thread::hardware_concurrency() - 1);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&TextureStreamer::workerLoop, this);
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+
+    for (streamJob* job : jobs) {
+        if (job->mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        if (job->pbo) free_pbos.push_back(job->pbo);
+        if (job->pixels) SOIL_free_image_data(job->pixels);
+        delete job;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!free_pbos.empty()) glDeleteBuffers(free_pbos.size(), &free_pbos[0]);
+}
+
+GLuint TextureStreamer::request(const std::string& imagePath) {
+    streamer_stats.requested++;
+
+    // A cooked texture is only mapped and copied, it isn't worth a round trip through the workers
+    std::string cooked = cookedTexturePath(imagePath.c_str());
+    if (!cooked.empty()) {
+        streamer_stats.uploaded++;
+        return loadCookedTexture(cooked.c_str());
+    }
+
+    // The placeholder, without mips until the image is in
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    streamJob* job = new streamJob();
+    job->texture = texture;
+    job->path = imagePath;
+    jobs.push_back(job);
+    streamer_stats.pending++;
+    push(job, false);
+    return texture;
+}
+
+void TextureStreamer::cancel(GLuint texture) {
+    for (streamJob* job : jobs) {
+        if (job->texture == texture) job->cancelled = true;
+    }
+}
+
+void TextureStreamer::push(streamJob* job, bool copy) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job->state = copy ? COPYING : DECODING;
+        work.push_back({ job, copy });
+    }
+    wake.notify_one();
+}
+
+void TextureStreamer::workerLoop() {
+    while (true) {
+        workItem item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !work.empty(); });
+            if (stopping) return;
+            item = work.front();
+            work.pop_front();
+        }
+        streamJob* job = item.job;
+
+        if (item.copy) {
+            ProfileScope scope("copy " + job->path);
+            std::memcpy(job->mapped, job->pixels, (size_t) job->width * job->height * 3);
+            std::lock_guard<std::mutex> lock(mutex);
+            job->state = COPIED;
+        }
+        else {
+            int width, height;
+            unsigned char* pixels;
+            std::string error;
+            {
+                ProfileScope scope("decode " + job->path);
+                pixels = decodeImageRGB(job->path.c_str(), width, height, error);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            job->pixels = pixels;
+            job->error = error;
+            job->width = width;
+            job->height = height;
+            job->state = pixels ? DECODED : FAILED;
+        }
+    }
+}
+
+GLuint TextureStreamer::acquirePBO() {
+    if (!free_pbos.empty()) {
+        GLuint pbo = free_pbos.back();
+        free_pbos.pop_back();
+        return pbo;
+    }
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    return pbo;
+}
+
+bool TextureStreamer::advance(streamJob* job, bool& finished) {
+    jobState state;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = job->state;
+        if (state == FAILED) error = job->error;
+    }
+    finished = false;
+    if (state == DECODING || state == COPYING) return false;
+
+    if (job->cancelled || state == FAILED) {
+        if (state == FAILED) std::cout << "Texture streaming error: " << job->path << ": " << error << std::endl;
+        if (job->mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (job->pbo) free_pbos.push_back(job->pbo);
+        finished = true;
+        return true;
+    }
+
+    GLsizeiptr size = (GLsizeiptr) job->width * job->height * 3;
+    if (state == DECODED) {
+        // Orphan the buffer and map it, a worker copies the pixels while the GL thread goes on
+        job->pbo = acquirePBO();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        job->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (job->mapped) {
+            push(job, true);
+            return true;
+        }
+        // Couldn't map it, upload from the decoded pixels instead
+    }
+
+    // COPIED (or a failed map): specify the texture from the buffer, the transfer doesn't block
+    glBindTexture(GL_TEXTURE_2D, job->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (job->mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        job->mapped = nullptr;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, job->width, job->height, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*) 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        free_pbos.push_back(job->pbo);
+        job->pbo = 0;
+    }
+    else {
+        if (job->pbo) free_pbos.push_back(job->pbo);
+        job->pbo = 0;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, job->width, job->height, 0, GL_RGB, GL_UNSIGNED_BYTE, job->pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    streamer_stats.uploaded++;
+    if (onUploaded) onUploaded(job->texture);
+    finished = true;
+    return true;
+}
+
+void TextureStreamer::update(float budget_ms) {
+    ProfileScope scope("texture uploads");
+    auto start = std::chrono::steady_clock::now();
+    auto spent = [&start]() {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    int steps = 0;
+    for (int i = 0; i < jobs.size(); ) {
+        if (steps > 0 && spent() > budget_ms) break;
+
+        streamJob* job = jobs[i];
+        bool finished;
+        if (advance(job, finished)) steps++;
+        if (finished) {
+            if (job->pixels) SOIL_free_image_data(job->pixels);
+            delete job;
+            jobs.erase(jobs.begin() + i);
+            streamer_stats.pending--;
+        }
+        else {
+            i++;
+        }
+    }
+    streamer_stats.upload_ms = spent();
+}
+
+void TextureStreamer::finish() {
+    while (!jobs.empty()) {
+        int pending = jobs.size();
+        update(1e9f);
+        // Everything left is with the workers
+        if (jobs.size() == pending) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef VVR_OGL_LABORATORY_TEXTURESTREAMER_H
+#define VVR_OGL_LABORATORY_TEXTURESTREAMER_H
+#include <GL/glew.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+struct textureStreamerStats {
+    int requested = 0;
+    int uploaded = 0;
+    int pending = 0;          //not uploaded yet
+    float upload_ms = 0.0f;   //GL thread time of the last update
+};
+
+/**
+* Loads textures without blocking the GL thread. request() returns a texture right away that holds
+* a 1x1 grey placeholder. The image is decoded by a pool of worker threads, one image at a time
+* because SOIL isn't reentrant (soilMutex()), and update() (on the GL thread, once per frame) moves
+* the decoded images into mapped pixel unpack buffers, which the workers fill, and then specifies the
+* texture from the buffer and generates its mips.
+* update() stops after its time budget, so a frame only pays for a few uploads.
+* Cooked images (.dtex) are loaded directly, there is nothing to decode.
+*
+*   TextureStreamer streamer;
+*   GLuint smoke = streamer.request("Textures/blue_smoke.png"); // placeholder until it's uploaded
+*   ...
+*   streamer.update(2.0f); // every frame
+*/
+class TextureStreamer {
+public:
+    TextureStreamer(int threads = 0); //0: one less than the hardware threads
+    ~TextureStreamer();
+
+    GLuint request(const std::string& imagePath);
+    //The texture was deleted by its owner, drop the work that is left for it
+    void cancel(GLuint texture);
+
+    //Uploads on the GL thread until budget_ms is spent (at least one step, so it always progresses)
+    void update(float budget_ms);
+    //Updates until every request is uploaded, for loading screens and the first frame
+    void finish();
+
+    //Called on the GL thread when the placeholder of a texture is replaced by its image
+    std::function<void(GLuint)> onUploaded;
+
+    const textureStreamerStats& stats() const { return streamer_stats; }
+
+private:
+    //DECODING and COPYING belong to a worker thread, the other states to the GL thread
+    enum jobState { DECODING, DECODED, COPYING, COPIED, FAILED };
+
+    struct streamJob {
+        GLuint texture = 0;
+        std::string path;
+        jobState state = DECODING;
+        bool cancelled = false;
+        unsigned char* pixels = nullptr;
+        std::string error; //why the decoding FAILED, SOIL_last_result() of the worker
+        int width = 0, height = 0;
+        GLuint pbo = 0;
+        void* mapped = nullptr;
+    };
+
+    //Work of the threads: decode a job's image, or copy its pixels into its mapped buffer
+    struct workItem {
+        streamJob* job;
+        bool copy;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<workItem> work;
+    std::mutex mutex; //guards work, stopping and the state of the jobs
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::deque<streamJob*> jobs; //in request order, only the GL thread adds and removes
+    std::vector<GLuint> free_pbos;
+    textureStreamerStats streamer_stats;
+
+    void workerLoop();
+    void push(streamJob* job, bool copy);
+    //One step of the GL thread for a job, false when it is still with a worker.
+    //finished is set when the job is done and can be deleted
+    bool advance(streamJob* job, bool& finished);
+    GLuint acquirePBO();
+};
+
+#endif //VVR_OGL_LABORATORY_TEXTURESTREAMER_H
@@ -0,0 +1,65 @@
+#include "UniformBuffer.h"
+#include <cstring>
+#include <stdexcept>
+
+UniformBufferAllocator::UniformBufferAllocator(GLsizeiptr _capacity) : capacity(_capacity) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    data.resize(capacity);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    GLint bindings = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &bindings);
+    bound.resize(bindings);
+}
+
+UniformBufferAllocator::~UniformBufferAllocator() {
+    glDeleteBuffers(1, &buffer);
+}
+
+GLintptr UniformBufferAllocator::allocate(GLsizeiptr size) {
+    GLintptr offset = (used + alignment - 1) / alignment * alignment;
+    if (offset + size > capacity) {
+        throw std::runtime_error("Uniform buffer is full");
+    }
+    used = offset + size;
+    return offset;
+}
+
+void UniformBufferAllocator::write(GLintptr offset, const void* block, GLsizeiptr size) {
+    std::memcpy(&data[offset], block, size);
+    dirty = true;
+}
+
+void UniformBufferAllocator::upload() {
+    if (!dirty) return;
+
+    // Orphan the old storage, so the draws of the last frame that still read it don't stall the upload
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, used, data.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    dirty = false;
+    uploads++;
+}
+
+void UniformBufferAllocator::bindRange(GLuint binding, GLintptr offset, GLsizeiptr size) {
+    boundRange& b = bound[binding];
+    if (b.offset == offset && b.size == size) return;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+    b.offset = offset;
+    b.size = size;
+    range_binds++;
+}
+
+void UniformBufferAllocator::bindBlock(GLuint program, const char* block_name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, block_name);
+    // Blocks that the program doesn't use are optimized out
+    if (index == GL_INVALID_INDEX) return;
+    glUniformBlockBinding(program, index, binding);
+}
@@ -0,0 +1,97 @@
+#ifndef VVR_OGL_LABORATORY_UNIFORMBUFFER_H
+#define VVR_OGL_LABORATORY_UNIFORMBUFFER_H
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Binding points of the uniform blocks that the shaders share
+#define FRAME_BLOCK_BINDING 0
+#define LIGHT_BLOCK_BINDING 1
+#define MATERIAL_BLOCK_BINDING 2
+
+// std140 layouts, they must match the blocks declared in the shaders.
+// Camera and light matrices of the frame (FrameData)
+struct frameBlock {
+    glm::mat4 V;
+    glm::mat4 P;
+    glm::mat4 PV;
+    glm::mat4 lightVP;
+    glm::vec4 camera_pos;   //w unused
+    glm::vec4 camera_right; //first row of V
+    glm::vec4 camera_up;    //second row of V
+};
+
+// LightData, same members as the Light struct the shader used before
+struct lightBlock {
+    glm::vec4 La;
+    glm::vec4 Ld;
+    glm::vec4 Ls;
+    glm::vec3 lightPosition_worldspace;
+    float power;
+};
+
+// MaterialData of ShadowMapping.fragmentshader
+struct materialBlock {
+    glm::vec4 Ka = glm::vec4(0.0f);
+    glm::vec4 Kd = glm::vec4(0.0f);
+    glm::vec4 Ks = glm::vec4(0.0f);
+    float Ns = 0.0f;
+    float alpha = 1.0f;
+    int useTexture = 0;
+    int useTransparency = 0;
+    //Layers of the maps in their texture arrays, -1 for none
+    int albedoLayer = -1;
+    int roughnessLayer = -1;
+    int metallicLayer = -1;
+};
+
+/**
+* One uniform buffer that holds every block of the frame. Blocks get an aligned range once (allocate),
+* are written into a CPU copy (write) and the whole used range is sent with one call per frame (upload).
+* Draws then only switch ranges (bindRange), which is skipped when the range is already bound.
+*
+*   GLintptr frame = ubo.allocate(sizeof(frameBlock));
+*   UniformBufferAllocator::bindBlock(program, "FrameData", FRAME_BLOCK_BINDING);
+*   ubo.write(frame, frame_data);
+*   ubo.upload();
+*   ubo.bindRange(FRAME_BLOCK_BINDING, frame, sizeof(frameBlock));
+*/
+class UniformBufferAllocator {
+public:
+    UniformBufferAllocator(GLsizeiptr _capacity = 64 * 1024);
+    ~UniformBufferAllocator();
+
+    //Offset of a new range of size bytes, aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLintptr allocate(GLsizeiptr size);
+
+    void write(GLintptr offset, const void* block, GLsizeiptr size);
+    template<typename T>
+    void write(GLintptr offset, const T& block) { write(offset, &block, sizeof(T)); }
+
+    //Sends what was written since the last upload, call it once per frame before the draws
+    void upload();
+
+    void bindRange(GLuint binding, GLintptr offset, GLsizeiptr size);
+
+    //Connects a block of the program to a binding point (GLSL 3.30 has no layout(binding))
+    static void bindBlock(GLuint program, const char* block_name, GLuint binding);
+
+    int uploads = 0;      //buffer updates since the start
+    int range_binds = 0;  //glBindBufferRange calls since the start
+
+private:
+    GLuint buffer = 0;
+    GLsizeiptr capacity;
+    GLsizeiptr used = 0;
+    GLint alignment = 256;
+    bool dirty = false;
+    std::vector<unsigned char> data;
+
+    struct boundRange {
+        GLintptr offset = -1;
+        GLsizeiptr size = 0;
+    };
+    std::vector<boundRange> bound;
+};
+
+#endif //VVR_OGL_LABORATORY_UNIFORMBUFFER_H
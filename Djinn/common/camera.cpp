@@ -122,6 +122,25 @@ void Camera::update(void) {
         FoV += fovSpeed;
     }
 
+    updateMatrices();
+
+    // For the next frame, the "last time" will be "now"
+    lastTime = currentTime;
+}
+
+void Camera::updateMatrices() {
+    vec3 direction(
+        cos(verticalAngle) * sin(horizontalAngle),
+        sin(verticalAngle),
+        cos(verticalAngle) * cos(horizontalAngle)
+    );
+    vec3 right(
+        sin(horizontalAngle - 3.14f / 2.0f),
+        0,
+        cos(horizontalAngle - 3.14f / 2.0f)
+    );
+    vec3 up = cross(right, direction);
+
     // Task 5.7: construct projection and view matrices
     projectionMatrix = perspective(radians(FoV), 4.0f / 3.0f, 0.1f, 200.0f);
     viewMatrix = lookAt(
@@ -129,7 +148,4 @@ void Camera::update(void) {
         position + direction,
         up
     );
-
-    // For the next frame, the "last time" will be "now"
-    lastTime = currentTime;
 }
\ No newline at end of file
@@ -33,6 +33,10 @@ public:
     void onMouseMove(double xPos, double yPos);
 
     void update();
+
+    // View and projection matrices from position, the angles and FoV, without reading the input
+    // (update calls it, djinn_bench moves the camera along its script)
+    void updateMatrices();
 };
 
 #endif
\ No newline at end of file
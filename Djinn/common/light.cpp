@@ -17,6 +17,7 @@ Light::Light(GLFWwindow* window,
     Ls = init_Ls;
     power = init_power;
     lightPosition_worldspace = init_position;
+    previousPosition_worldspace = init_position;
 
     // setting near and far plane affects the detail of the shadow
     nearPlane = 1.0;
@@ -36,6 +37,13 @@ Light::Light(GLFWwindow* window,
 
 void Light::update() {
 
+    previousPosition_worldspace = lightPosition_worldspace;
+
+    // Without a window (djinn_bench, a replayed session) there are no keys, the light stays where it is
+    if (window == nullptr) {
+        updateViewMatrix(lightPosition_worldspace);
+        return;
+    }
 
    // Move across z-axis
     if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
@@ -59,11 +67,19 @@ void Light::update() {
         lightPosition_worldspace -= lightSpeed * vec3(0.0, 1.0, 0.0);
     }
 
+    updateViewMatrix(lightPosition_worldspace);
+}
+
+void Light::interpolate(float alpha) {
+    updateViewMatrix(mix(previousPosition_worldspace, lightPosition_worldspace, alpha));
+}
+
+void Light::updateViewMatrix(glm::vec3 position) {
     // We have the direction of the light and the point where the light is looking at
     // We will use this information to calculate the "up" vector, 
     // just like we did with the camera
 
-    direction = normalize(targetPosition - lightPosition_worldspace);
+    direction = normalize(targetPosition - position);
 
 
     // converting direction to cylidrical coordinates
@@ -89,7 +105,7 @@ void Light::update() {
     vec3 up = cross(right, direction);
    
     viewMatrix = lookAt(
-        lightPosition_worldspace,
+        position,
         targetPosition,
         up 
     );
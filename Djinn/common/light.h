@@ -9,6 +9,8 @@ public:
     glm::mat4 projectionMatrix;
 
     glm::vec3 lightPosition_worldspace;
+    // Position before the last update, for interpolated rendering
+    glm::vec3 previousPosition_worldspace;
 
     glm::vec4 La;
     glm::vec4 Ld;
@@ -34,7 +36,14 @@ public:
         glm::vec3 init_position,
         float init_power);
   
+    // Moves the light with the keyboard, called once per simulation step
     void update();
 
+    // Rebuilds the view matrix between the previous and the current position
+    void interpolate(float alpha);
+
     glm::mat4 lightVP();
+
+private:
+    void updateViewMatrix(glm::vec3 position);
 };
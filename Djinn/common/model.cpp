@@ -7,6 +7,7 @@
 #include "util.h"
 #include "model.h"
 #include "texture.h"
+#include "Profiler.h"
 
 using namespace glm;
 using namespace std;
@@ -327,6 +328,7 @@ void indexVBO(
 }
 
 Drawable::Drawable(string path) {
+    ProfileScope scope("load " + path);
     if (path.substr(path.size() - 3, 3) == "obj") {
         loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
     } else if (path.substr(path.size() - 3, 3) == "vtp") {
@@ -362,6 +364,7 @@ void Drawable::draw(int mode) {
 void Drawable::createContext() {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    bounds = computeBounds(indexedVertices);
 
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
@@ -415,7 +418,7 @@ Mesh::Mesh(Mesh&& other)
     uvs{std::move(other.uvs)}, indexedUVS{std::move(other.indexedUVS)},
     indices{std::move(other.indices)}, mtl{std::move(other.mtl)},
     VAO{other.VAO}, verticesVBO{other.verticesVBO}, normalsVBO{other.normalsVBO},
-    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO} {
+    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO}, bounds{other.bounds} {
     other.VAO = 0;
     other.verticesVBO = 0;
     other.normalsVBO = 0;
@@ -442,6 +445,7 @@ void Mesh::draw(int mode) {
 void Mesh::createContext() {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    bounds = computeBounds(indexedVertices);
 
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
@@ -480,17 +484,20 @@ void Mesh::createContext() {
 
 Model::Model(string path, Model::MTLUploadFunction* uploader)
     : uploadFunction{uploader} {
+    ProfileScope scope("load " + path);
     if (path.substr(path.size() - 3, 3) == "obj") {
         loadOBJWithTiny(path.c_str());
     } else {
         throw runtime_error("File format not supported: " + path);
     }
+
+    for (int i = 0; i < meshes.size(); i++) {
+        bounds = i == 0 ? meshes[i].bounds : mergeBounds(bounds, meshes[i].bounds);
+    }
 }
 
 Model::~Model() {
-    for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
-    }
+    // the handles release the textures
 }
 
 void Model::draw() {
@@ -577,8 +584,6 @@ void Model::loadOBJWithTiny(const std::string& filename) {
 void Model::loadTexture(const std::string& filename) {
     if (filename.length() == 0) return;
     if (textures.find(filename) == end(textures)) {
-        GLuint id = loadSOIL(filename.c_str());
-        if (!id) throw std::runtime_error("Failed to load texture: " + filename);
-        textures[filename] = id;
+        textures[filename] = TextureManager::instance().acquire(filename);
     }
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <string>
 #include <map>
 #include <glm/glm.hpp>
+#include "BoundingVolume.h"
+#include "TextureManager.h"
 
 static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE{};
 static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE{};
@@ -83,6 +85,8 @@ public:
     std::vector<unsigned int> indices;
 
     GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    //In model space, computed from indexedVertices at load time
+    boundingVolume bounds;
 
 private:
     void createContext();
@@ -96,10 +100,10 @@ namespace ogl {
         glm::vec4 Kd;
         glm::vec4 Ks;
         float Ns;
-        GLuint texKa;
-        GLuint texKd;
-        GLuint texKs;
-        GLuint texNs;
+        TextureHandle texKa;
+        TextureHandle texKd;
+        TextureHandle texKs;
+        TextureHandle texNs;
     };
 
     class Mesh {
@@ -119,6 +123,7 @@ namespace ogl {
         std::vector<unsigned int> indices;
         Material mtl;
         GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+        boundingVolume bounds;
     private:
         void createContext();
     };
@@ -129,9 +134,12 @@ namespace ogl {
         Model(std::string path, MTLUploadFunction* uploader = nullptr);
         ~Model();
         void draw();
+    public:
+        //All the meshes, in model space
+        boundingVolume bounds;
     private:
         std::vector<Mesh> meshes;
-        std::map<std::string, GLuint> textures;
+        std::map<std::string, TextureHandle> textures; //shared with the other models (TextureManager)
         MTLUploadFunction* uploadFunction;
     private:
         void loadOBJWithTiny(const std::string& filename);
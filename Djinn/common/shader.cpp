@@ -3,34 +3,56 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
 using namespace std;
 
 #include "shader.h"
+#include "Profiler.h"
 
-void compileShader(GLuint& shaderID, const char* file) {
-    // read shader code from the file
-    std::string shaderCode;
-    std::ifstream shaderStream(file, std::ios::in);
-    if (shaderStream.is_open()) {
-        std::string Line = "";
-        while (getline(shaderStream, Line)) {
-            shaderCode += "\n" + Line;
-        }
-        shaderStream.close();
-    } else {
+// Directory of the program binaries, empty when the cache is off
+static string shaderCacheDirectory;
+
+void setShaderCacheDirectory(const std::string& directory) {
+    shaderCacheDirectory = directory;
+}
+
+std::string readShaderFile(const char* file, const std::string& defines) {
+    // the whole file in one read
+    std::ifstream shaderStream(file, std::ios::in | std::ios::binary);
+    if (!shaderStream.is_open()) {
         throw runtime_error(string("Can't open shader file: ") + file);
     }
+    shaderStream.seekg(0, std::ios::end);
+    std::string shaderCode((size_t) shaderStream.tellg(), '\0');
+    shaderStream.seekg(0, std::ios::beg);
+    shaderStream.read(&shaderCode[0], shaderCode.size());
+    shaderStream.close();
 
-    GLint result = GL_FALSE;
-    int infoLogLength;
+    // The defines must come after #version, #line keeps the line numbers of the errors
+    if (!defines.empty()) {
+        size_t version = shaderCode.find("#version");
+        size_t line_end = version == string::npos ? 0 : shaderCode.find('\n', version);
+        if (line_end == string::npos) line_end = shaderCode.size();
+        int next_line = (int) std::count(shaderCode.begin(), shaderCode.begin() + line_end, '\n') + 2;
+        shaderCode.insert(line_end, "\n" + defines + "#line " + to_string(next_line));
+    }
+    return shaderCode;
+}
 
-    // compile Vertex Shader
+// Starts the compilation, the status is read by checkShader
+void submitShader(GLuint shaderID, const char* file, const std::string& shaderCode) {
     cout << "Compiling shader: " << file << endl;
     char const* sourcePointer = shaderCode.c_str();
     glShaderSource(shaderID, 1, &sourcePointer, NULL);
     glCompileShader(shaderID);
+}
 
-    // check Vertex Shader
+void checkShader(GLuint shaderID) {
+    GLint result = GL_FALSE;
+    int infoLogLength;
     glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
     glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0) {
@@ -41,32 +63,12 @@ void compileShader(GLuint& shaderID, const char* file) {
     }
 }
 
-GLuint loadShaders(const char* vertexFilePath,
-                   const char* fragmentFilePath,
-                   const char* geometryFilePath) {
-    // Create the shaders
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    compileShader(vertexShaderID, vertexFilePath);
-
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    compileShader(fragmentShaderID, fragmentFilePath);
-
-    GLuint geometryShaderID = 0;
-    if (geometryFilePath) {
-        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
-        compileShader(geometryShaderID, geometryFilePath);
-    }
-
-    // Link the program
-    cout << "Linking shaders... " << endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    if (geometryFilePath)
-        glAttachShader(programID, geometryShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
+void compileShader(GLuint& shaderID, const char* file, const std::string& defines = std::string()) {
+    submitShader(shaderID, file, readShaderFile(file, defines));
+    checkShader(shaderID);
+}
 
-    // Check the program
+bool checkProgram(GLuint programID) {
     GLint result = GL_FALSE;
     int infoLogLength;
     glGetProgramiv(programID, GL_LINK_STATUS, &result);
@@ -77,17 +79,214 @@ GLuint loadShaders(const char* vertexFilePath,
         //throw runtime_error(string(&programErrorMessage[0]));
         cout << &programErrorMessage[0] << endl;
     }
+    return result == GL_TRUE;
+}
 
-    glDetachShader(programID, vertexShaderID);
-    glDeleteShader(vertexShaderID);
+// --- Program binary cache ---
+// A file for every program: its name is the hash of the sources and the driver, and the driver
+// string is stored again in the file, a binary of another driver (or a collision) is compiled again.
+// Layout: magic, length + driver string, binary format, length + binary
+
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x42504a44; // "DJPB"
+
+bool programCacheEnabled() {
+    if (shaderCacheDirectory.empty() || !GLEW_ARB_get_program_binary) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// Vendor, renderer and version: a binary is only valid for the driver that created it
+string driverString() {
+    string driver;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const GLubyte* value = glGetString(name);
+        driver += value ? (const char*) value : "";
+        driver += "|";
+    }
+    return driver;
+}
+
+// FNV-1a
+uint64_t hashString(const string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+string programCachePath(const string& key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) hashString(key));
+    return shaderCacheDirectory + "/" + name;
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value) {
+    return (bool) file.read((char*) &value, sizeof(T));
+}
+
+// 0 when the program isn't cached or the driver doesn't accept the binary
+GLuint loadProgramBinary(const string& path, const string& driver) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) return 0;
+
+    uint32_t magic = 0, driverLength = 0, binaryLength = 0;
+    GLenum format = 0;
+    if (!readValue(file, magic) || magic != PROGRAM_CACHE_MAGIC) return 0;
+    if (!readValue(file, driverLength) || driverLength != driver.size()) return 0;
+    string cachedDriver(driverLength, '\0');
+    if (!file.read(&cachedDriver[0], driverLength) || cachedDriver != driver) return 0;
+    if (!readValue(file, format) || !readValue(file, binaryLength)) return 0;
+    std::vector<char> binary(binaryLength);
+    if (binaryLength == 0 || !file.read(&binary[0], binaryLength)) return 0;
+
+    GLuint programID = glCreateProgram();
+    glProgramBinary(programID, format, &binary[0], (GLsizei) binaryLength);
+    GLint result = GL_FALSE;
+    glGetProgramiv(programID, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        // e.g. the driver was updated without changing its version string
+        glDeleteProgram(programID);
+        return 0;
+    }
+    return programID;
+}
+
+void saveProgramBinary(GLuint programID, const string& path, const string& driver) {
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(programID, length, NULL, &format, &binary[0]);
+
+    std::error_code error;
+    std::filesystem::create_directories(shaderCacheDirectory, error);
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        cout << "Can't write the shader cache: " << path << endl;
+        return;
+    }
+    uint32_t magic = PROGRAM_CACHE_MAGIC, driverLength = driver.size(), binaryLength = length;
+    file.write((const char*) &magic, sizeof(magic));
+    file.write((const char*) &driverLength, sizeof(driverLength));
+    file.write(driver.data(), driverLength);
+    file.write((const char*) &format, sizeof(format));
+    file.write((const char*) &binaryLength, sizeof(binaryLength));
+    file.write(&binary[0], binaryLength);
+}
+
+std::vector<GLuint> loadShaderBatch(const std::vector<programSource>& sources) {
+    ProfileScope scope("shader batch");
+    std::vector<GLuint> programs(sources.size(), 0);
+    bool useCache = programCacheEnabled();
+    string driver = useCache ? driverString() : string();
+
+    // Let the driver compile on all of its threads, if it can
+    static bool parallelCompile = false;
+    if (!parallelCompile && GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallelCompile = true;
+    }
+
+    struct pendingProgram {
+        int index;
+        string cachePath;
+        GLuint shaders[3];
+    };
+    std::vector<pendingProgram> pending;
+
+    // Step 1: the cached programs, and the compilations of all the others.
+    // No status is read here, so a parallel compiler works on all of them at once
+    for (int i = 0; i < sources.size(); i++) {
+        const programSource& source = sources[i];
+        const char* files[3] = { source.vertexFilePath, source.fragmentFilePath, source.geometryFilePath };
+        const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
 
-    if (geometryFilePath) {
-        glDetachShader(programID, geometryShaderID);
-        glDeleteShader(geometryShaderID);
+        string code[3];
+        string key = driver;
+        for (int stage = 0; stage < 3; stage++) {
+            if (!files[stage]) continue;
+            code[stage] = readShaderFile(files[stage], source.defines);
+            key += "|" + code[stage];
+        }
+
+        pendingProgram program = { i, string(), { 0, 0, 0 } };
+        if (useCache) {
+            program.cachePath = programCachePath(key);
+            programs[i] = loadProgramBinary(program.cachePath, driver);
+            if (programs[i] != 0) {
+                cout << "Loaded cached program: " << source.vertexFilePath << endl;
+                continue;
+            }
+        }
+
+        for (int stage = 0; stage < 3; stage++) {
+            if (!files[stage]) continue;
+            program.shaders[stage] = glCreateShader(types[stage]);
+            submitShader(program.shaders[stage], files[stage], code[stage]);
+        }
+        pending.push_back(program);
+    }
+
+    // Step 2: Link the programs
+    for (pendingProgram& program : pending) {
+        GLuint programID = glCreateProgram();
+        for (GLuint shaderID : program.shaders) {
+            if (shaderID) glAttachShader(programID, shaderID);
+        }
+        if (useCache) glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(programID);
+        programs[program.index] = programID;
     }
 
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(fragmentShaderID);
+    // Step 3: Check the programs, this waits for the compiler
+    for (pendingProgram& program : pending) {
+        GLuint programID = programs[program.index];
+        cout << "Linking shaders... " << endl;
+        for (GLuint shaderID : program.shaders) {
+            if (shaderID) checkShader(shaderID);
+        }
+        bool linked = checkProgram(programID);
+
+        for (GLuint shaderID : program.shaders) {
+            if (!shaderID) continue;
+            glDetachShader(programID, shaderID);
+            glDeleteShader(shaderID);
+        }
+
+        if (linked && useCache) saveProgramBinary(programID, program.cachePath, driver);
+        cout << "Shader program complete." << endl;
+    }
+
+    return programs;
+}
+
+GLuint loadShaders(const char* vertexFilePath,
+                   const char* fragmentFilePath,
+                   const char* geometryFilePath,
+                   const std::string& defines) {
+    return loadShaderBatch({ { vertexFilePath, fragmentFilePath, geometryFilePath, defines } })[0];
+}
+
+GLuint loadTransformFeedbackShader(const char* vertexFilePath,
+                                   const std::vector<const char*>& varyings) {
+    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+    compileShader(vertexShaderID, vertexFilePath);
+
+    // the varyings must be declared before linking
+    cout << "Linking transform feedback shader... " << endl;
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, vertexShaderID);
+    glTransformFeedbackVaryings(programID, (GLsizei) varyings.size(), &varyings[0],
+                                GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(programID);
+    checkProgram(programID);
+
+    glDetachShader(programID, vertexShaderID);
+    glDeleteShader(vertexShaderID);
 
     cout << "Shader program complete." << endl;
 
@@ -1,8 +1,44 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <vector>
+#include <string>
+
+/**
+* Linked programs are saved in this directory (glGetProgramBinary) and loaded from it on the next
+* run instead of being compiled. Off until a directory is set, and without ARB_get_program_binary.
+*/
+void setShaderCacheDirectory(const std::string& directory);
+
+//The files of one program, geometryFilePath may be null
+struct programSource {
+    const char* vertexFilePath;
+    const char* fragmentFilePath;
+    const char* geometryFilePath = nullptr;
+    std::string defines;
+};
+
+/**
+* Loads the programs together: the cached ones from their binaries, and all the others are
+* compiled and linked before the status of any of them is read, so a driver with
+* ARB_parallel_shader_compile builds them at the same time. Same order as the sources.
+*/
+std::vector<GLuint> loadShaderBatch(const std::vector<programSource>& sources);
+
+/**
+* defines: lines such as "#define USE_TEXTURE 1\n" that are put right after the #version line
+* of every stage, for the variants of one shader (see ShaderVariants).
+*/
 GLuint loadShaders(const char* vertexFilePath,
                    const char* fragmentFilePath,
-                   const char* geometryFilePath = nullptr);
+                   const char* geometryFilePath = nullptr,
+                   const std::string& defines = std::string());
+
+/**
+* Vertex only program whose outputs (varyings) are captured interleaved with
+* transform feedback. Used for simulations that run entirely on the GPU.
+*/
+GLuint loadTransformFeedbackShader(const char* vertexFilePath,
+                                   const std::vector<const char*>& varyings);
 
 #endif
\ No newline at end of file
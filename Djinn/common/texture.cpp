@@ -3,7 +3,11 @@
 #include <SOIL.h>
 #include <string.h>
 #include <iostream>
+#include <filesystem>
 #include "texture.h"
+#include "CookedTexture.h"
+#include "MappedFile.h"
+#include "Profiler.h"
 using namespace std;
 
 GLuint loadBMP(const char* imagePath) {
@@ -217,6 +221,7 @@ GLuint loadSOIL(const char* imagePath) {
     cout << "Reading image: " << imagePath << endl;
 
     GLuint texture = 0;
+    std::lock_guard<std::mutex> lock(soilMutex());
 
     //Load Image File Directly into an OpenGL Texture
     texture = SOIL_load_OGL_texture
@@ -233,4 +238,89 @@ GLuint loadSOIL(const char* imagePath) {
     }
 
     return texture;
-}
\ No newline at end of file
+}
+
+std::mutex& soilMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+unsigned char* decodeImageRGB(const char* imagePath, int& width, int& height, std::string& error) {
+    std::lock_guard<std::mutex> lock(soilMutex());
+    int channels;
+    unsigned char* pixels = SOIL_load_image(imagePath, &width, &height, &channels, SOIL_LOAD_RGB);
+    if (!pixels) error = SOIL_last_result();
+    return pixels;
+}
+
+GLenum cookedTextureFormat(unsigned int format) {
+    switch (format) {
+        case COOKED_BC1:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case COOKED_BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case COOKED_BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        default:
+            return 0;
+    }
+}
+
+GLuint loadCookedTexture(const char* cookedPath) {
+    cout << "Reading cooked texture: " << cookedPath << endl;
+
+    MappedFile file(cookedPath);
+    if (!file.data) {
+        throw runtime_error(string("Cooked texture could not be opened: ") + cookedPath);
+    }
+
+    // Validate the header and the mip table before anything reaches GL
+    const cookedTextureHeader* header = cookedHeader(file.data, file.size);
+    GLenum format = header ? cookedTextureFormat(header->format) : 0;
+    if (!format) {
+        throw runtime_error(string("Not a correct cooked texture: ") + cookedPath);
+    }
+    const cookedMip* mips = cookedMips(file.data);
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Every level straight from the mapped file, no copy on our side
+    for (unsigned int level = 0; level < header->mip_count; level++) {
+        const cookedMip& mip = mips[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, mip.width, mip.height,
+                               0, mip.size, file.data + mip.offset);
+    }
+
+    // Same sampling as the SOIL textures (SOIL_FLAG_TEXTURE_REPEATS), with the cooked mips
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->mip_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    return textureID;
+}
+
+std::string cookedTexturePath(const char* imagePath) {
+    // The cooked file is used only while it is newer than its image
+    std::filesystem::path cooked(imagePath);
+    cooked.replace_extension(".dtex");
+    std::error_code error;
+    auto cookedTime = std::filesystem::last_write_time(cooked, error);
+    if (error) return std::string();
+    auto imageTime = std::filesystem::last_write_time(imagePath, error);
+    if (!error && cookedTime < imageTime) {
+        cout << "Cooked texture is older than its image, run texcook again: " << cooked.string() << endl;
+        return std::string();
+    }
+    return cooked.string();
+}
+
+GLuint loadTexture(const char* imagePath) {
+    ProfileScope scope(std::string("load ") + imagePath);
+    std::string cooked = cookedTexturePath(imagePath);
+    if (!cooked.empty()) return loadCookedTexture(cooked.c_str());
+    return loadSOIL(imagePath);
+}
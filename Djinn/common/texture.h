@@ -2,6 +2,8 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
+#include <string>
+#include <mutex>
 
 /**
 * A simple .bmp loader. Use loadSOIL() instead.
@@ -28,4 +30,38 @@ GLuint loadDDS(const char* imagePath);
 */
 GLuint loadSOIL(const char* imagePath);
 
+/**
+* SOIL (and the stb_image_aug inside it) isn't reentrant, and SOIL_last_result() is a global that
+* any thread overwrites. Every call into SOIL holds this lock, on every thread.
+*/
+std::mutex& soilMutex();
+
+/**
+* The RGB pixels of the image, decoded under soilMutex() so any thread can call it. Free them with
+* SOIL_free_image_data(). Returns nullptr on failure, with the reason of SOIL in error.
+*/
+unsigned char* decodeImageRGB(const char* imagePath, int& width, int& height, std::string& error);
+
+/**
+* A .dtex file of texcook (common/CookedTexture.h): the file is mapped once and every
+* block compressed mip goes to glCompressedTexImage2D as it is, nothing is decoded.
+*/
+GLuint loadCookedTexture(const char* cookedPath);
+
+/**
+* The cooked version of the image (same path, .dtex extension) when there is one that is
+* newer than the image, otherwise loadSOIL().
+*/
+GLuint loadTexture(const char* imagePath);
+
+/**
+* GL internal format of a cookedFormat, 0 for an unknown one.
+*/
+GLenum cookedTextureFormat(unsigned int format);
+
+/**
+* The path of the cooked version of the image, empty when there isn't one or it is older than the image.
+*/
+std::string cookedTexturePath(const char* imagePath);
+
 #endif
\ No newline at end of file
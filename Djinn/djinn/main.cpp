@@ -1,6 +1,7 @@
 // Include C++ headers
 #include <iostream>
 #include <string>
+#include <cctype>
 #include <vector>
 #include <stdio.h>
 #include <SOIL.h>
@@ -15,8 +16,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// Include ImGui (profiler overlay)
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_opengl3.h>
+
 // Shader loading utilities and other
 #include <common/shader.h>
+#include <common/ShaderVariants.h>
 #include <common/util.h>
 #include <common/camera.h>
 #include <common/model.h>
@@ -24,10 +31,27 @@
 #include <common/light.h>
 #include <common/SmokeEmitter.h>
 #include <common/CoinRainEmitter.h>
-
-//TODO delete the includes afterwards
-#include <chrono>
-using namespace std::chrono;
+#include <common/GPUCoinRainEmitter.h>
+#include <common/GPUCoinRainRenderer.h>
+#include <common/ParticleSystem.h>
+#include <common/SimulationClock.h>
+#include <common/CollisionMesh.h>
+#include <common/OITBuffer.h>
+#include <common/RenderQueue.h>
+#include <common/UniformBuffer.h>
+#include <common/InstancedDrawable.h>
+#include <common/ShadowCache.h>
+#include <common/TextureArrays.h>
+#include <common/TextureManager.h>
+#include <common/TextureStreamer.h>
+#include <common/SmokeFluidSolver.h>
+#include <common/Profiler.h>
+#include <common/SessionRecorder.h>
+
+#ifdef DJINN_BENCH
+#include <common/OffscreenContext.h>
+#include <common/Bench.h>
+#endif // DJINN_BENCH
 
 using namespace std;
 using namespace glm;
@@ -39,6 +63,9 @@ void createContext();
 void mainLoop();
 void free();
 void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mods);
+#ifndef DJINN_BENCH
+void onKey(GLFWwindow* window, int key, int scancode, int action, int mods);
+#endif // DJINN_BENCH
 
 #define W_WIDTH 1024
 #define W_HEIGHT 768
@@ -47,9 +74,26 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 #define SHADOW_WIDTH 1024
 #define SHADOW_HEIGHT 1024
 
-// Number of particles created
+// Maximum number of particles, the particle system lowers them when the frame budget is exceeded
 #define NUM_COINS 200
 #define NUM_PARTICLES 200
+// Coins piled on the table, drawn with one instanced draw per pass
+#define NUM_TABLE_COINS 2000
+// CPU update + GPU draw time (ms) that all the particles may use in a frame
+#define PARTICLE_FRAME_BUDGET 4.0f
+// GPU memory of the shared textures (TextureManager), unused ones are evicted above it
+#define TEXTURE_BUDGET_BYTES (256u << 20)
+// GL thread time per frame for the uploads of the streamed textures
+#define TEXTURE_UPLOAD_BUDGET_MS 2.0f
+
+// Cell size of the smoke fluid solver, the grid covers the space between the lamp and the Djinn
+#define SMOKE_FLUID_CELL 0.35f
+
+// Where the T key writes the Chrome trace of the last frames (chrome://tracing or ui.perfetto.dev)
+#define TRACE_PATH "djinn_trace.json"
+
+// Simulate the coin rain on the GPU with transform feedback instead of the CPU (CoinRainEmitter)
+// #define USE_GPU_COIN_RAIN
 
 #define RAND ((float) rand()) / (float) RAND_MAX
 
@@ -65,27 +109,47 @@ struct Material {
 GLFWwindow* window;
 Camera* camera;
 Light* light;
+SimulationClock simClock; // fixed timestep for the particles, the djinn and the light
+
+// Framebuffer that the scene is drawn into: the window's, or the offscreen one of djinn_bench
+GLuint sceneFrameBuffer = 0;
+int sceneWidth = 2 * W_WIDTH, sceneHeight = 2 * W_HEIGHT;
+
+// False when djinn_bench found a golden frame that changed, the exit code of the program
+bool passed = true;
+
+#ifdef DJINN_BENCH
+// djinn_bench: no window, the frames follow a script and the timings are written as JSON (Bench.h)
+OffscreenContext* offscreen;
+benchOptions benchSettings;
+#else
+// --record / --replay: the input, the camera and the frame times of a session (SessionRecorder.h)
+SessionRecorder session;
+string recordPath, replayPath;
+#endif // DJINN_BENCH
 
 // Shaders
 GLuint depthProgram; // Depth Shaders
-GLuint shadowMapShaderProgram; // Shadow Map Shaders
+ShaderVariants* shadowMapVariants; // Shadow Map Shaders, one program for every material path (lightingProgram)
 GLuint coinRainShaderProgram; // Coin Rain Shaders
 GLuint blueSmokeShaderProgram; // Blue Smoke Shaders
+GLuint coinRainUpdateProgram; // Coin Rain transform feedback update (GPU backend)
+GLuint oitCompositeProgram; // Resolves the weighted blended transparency over the scene
 
 // Djinn
 Model *djinnMesh;
-GLuint djinnAlbedoTexture;
+int djinnAlbedoTexture; // maps in materialTextures
 mat4 djinnModelMatrix = mat4(1.0f);
 float djinnTransparency = 0.0f;
 
 // Genie Lamp
 Drawable* lamp;
-GLuint lampAlbedoTexture, lampRoughnessTexture, lampMetallicTexture;
+int lampAlbedoTexture, lampRoughnessTexture, lampMetallicTexture; // maps in materialTextures
 mat4 lampModelMatrix = mat4(1.0f);
 
 // Table
 Drawable* table;
-GLuint tableAlbedoTexture, tableRoughnessTexture;
+int tableAlbedoTexture, tableRoughnessTexture; // maps in materialTextures
 mat4 tableModelMatrix = mat4(1.0f);
 
 // Walls and roof(wall5)
@@ -99,69 +163,68 @@ Drawable* wall4;
 mat4 wall4ModelMatrix = mat4(1.0f);
 Drawable* wall5;
 mat4 wall5ModelMatrix = mat4(1.0f);
-GLuint wallAlbedoTexture, wallRoughnessTexture;
+int wallAlbedoTexture, wallRoughnessTexture; // maps in materialTextures
 
 // Floor
 Drawable* gfloor;
-GLuint floorAlbedoTexture, floorRoughnessTexture;
+int floorAlbedoTexture, floorRoughnessTexture; // maps in materialTextures
 mat4 floorModelMatrix = mat4(1.0f);
 
 // Clouds (for the rain of coins)
 Drawable* clouds;
-GLuint cloudAlbedoTexture, cloudRoughnessTexture;
+int cloudAlbedoTexture, cloudRoughnessTexture; // maps in materialTextures
 mat4 cloudsModelMatrix = mat4(1.0f);
 float cloudTransparency = 0.0f;
 
 // --------------- Particles --------------------
+// Owns and schedules all the emitters
+ParticleSystem* particles;
+// Static scene geometry (lamp, table, walls, floor) that the coins collide with
+CollisionMesh* sceneCollision;
+
 // Coins
-Drawable* coin;
-GLuint coinColor, coinDiffuceColorSampler;
+Drawable* coin; // sampled from the albedo layer of the lamp
+// Pile of coins on the table (key C)
+InstancedDrawable* coinPile;
 // The position that the rain starts
-CoinRainEmitter* r_emitter;
+int coinRainEmitterId;
 glm::vec3 rain_emitter_pos(0.0f, 20.0f, 0.0f);
 
 // Blue Smoke
 Drawable* smoke;
-GLuint smokeTexture, smokeDiffuceColorSampler;
+TextureHandle smokeTexture;
 // Where the particles of the smoke should stop being rendered
 float height_threshold = 5.0f;
 // The position that the smoke starts
-SmokeEmitter* s_emitter;
+int smokeEmitterId;
 glm::vec3 smoke_emitter_pos(0.0f, 0.0f, 0.0f);
+// Air around the lamp that carries the smoke when use_smoke_fluid is on
+SmokeFluidSolver* smokeFluid;
 
 GLuint depthFrameBuffer, depthTexture;
+// Depth of the static casters, reused while the light and the static objects don't move
+ShadowCache* shadowCache;
 
-// Projection-View-Model Matrixes
-GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation, projectionAndViewMatrix;
-
-// Light Properties
-GLuint lightPositionLocation;
-GLuint lightPowerLocation;
-
-// For the Shader, in order to send the planeCoeffs
-GLuint planeLocation;
+// Accumulation targets of the order independent transparency
+OITBuffer* oit;
 
-GLuint KaLocation, KdLocation, KsLocation, NsLocation;
-GLuint LaLocation, LdLocation, LsLocation;
+// Sorts and submits the draws of the scene objects
+RenderQueue* renderQueue;
+// The maps of the materials, packed into one texture array for every size
+TextureArrays* materialTextures;
+// Decodes the shared textures on worker threads, they show a placeholder until they are uploaded
+TextureStreamer* textureStreamer;
+int lampMaterial, tableMaterial, floorMaterial, wallMaterial, cloudMaterial, djinnMaterial, coinMaterial;
 
-// Textures
-GLuint albedoColorSampler;		// Diffuse	
-GLuint roughnessColorSampler;	// Specular
-GLuint metallicColorSampler;
+// Uniform blocks: the camera and light matrices and the light are written once per frame,
+// the materials have a range each (set by the render queue)
+UniformBufferAllocator* uniformBuffer;
+GLintptr frameBlockOffset, lightBlockOffset;
 
-// For If statements inside the Shaders
-GLuint useTextureLocation, alphaLocation, transparencyLocation;
-
-GLuint depthMapSampler;
-GLuint lightVPLocation;
 GLuint lightDirectionLocation;
 GLuint lightFarPlaneLocation;
 GLuint lightNearPlaneLocation;
 
-// locations for depthProgram
-GLuint shadowViewProjectionLocation; 
-GLuint shadowModelLocation;
-
 // locations for particleProgram
 GLuint particleViewProjectionLocation; 
 GLuint particleModelLocation;
@@ -169,6 +232,9 @@ GLuint particleModelLocation;
 // To change the modelMatrixes
 mat4 rotationX, rotationZ, djinn_rotation;
 vec3 djinn_translation, djinn_scaling;
+// How far the djinn has come out of the lamp, and its thickness at the last two simulated steps
+float djinn_progress = 0.0f, djinn_counter = 0.0f;
+float thickness_factor = 0.0f, previous_thickness_factor = 0.0f;
 
 // To change the transparency for the djinn Mesh
 vec4 planeCoeffs;
@@ -180,16 +246,73 @@ bool blue_smoke = false; 				// If it's true, the smoke starts coming out of the
 bool game_paused = false; 				// If it's true, the particles stop moving
 bool use_sorting = true;				// If it's true, the program uses sorting
 bool use_rotations = true;				// If it's true, the program uses rotations
+bool use_billboards = true;				// If it's true, the particles face the camera in the vertex shader
+bool use_smoke_fluid = false;			// If it's true, the smoke follows the fluid solver instead of its curves
+bool use_oit = false;					// If it's true, the smoke, clouds and Djinn use order independent transparency (no sorting)
+bool show_coin_pile = false;			// If it's true, a pile of coins lies on the table
 bool tremble_action = false;			// If it's true, the lamp trembles
 bool start_cloud_transparency = false;	// If it's true, the clouds start to get non transparent
 
-// Creating a function to upload the light parameters to the shader program
-void uploadLight(const Light& light) {
-	glUniform4f(LaLocation, light.La.r, light.La.g, light.La.b, light.La.a);
-	glUniform4f(LdLocation, light.Ld.r, light.Ld.g, light.Ld.b, light.Ld.a);
-	glUniform4f(LsLocation, light.Ls.r, light.Ls.g, light.Ls.b, light.Ls.a);
-	glUniform3f(lightPositionLocation, light.lightPosition_worldspace.x, light.lightPosition_worldspace.y, light.lightPosition_worldspace.z);    
-	glUniform1f(lightPowerLocation, light.power);
+// Writes the camera, the light and the materials of this frame and uploads them with one buffer update
+void uploadFrameBlocks(const mat4& viewMatrix, const mat4& projectionMatrix, Light& light) {
+	frameBlock frame;
+	frame.V = viewMatrix;
+	frame.P = projectionMatrix;
+	frame.PV = projectionMatrix * viewMatrix;
+	frame.lightVP = light.lightVP();
+	frame.camera_pos = vec4(camera->position, 1.0f);
+	frame.camera_right = vec4(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0], 0.0f);
+	frame.camera_up = vec4(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1], 0.0f);
+	uniformBuffer->write(frameBlockOffset, frame);
+
+	lightBlock light_block;
+	light_block.La = light.La;
+	light_block.Ld = light.Ld;
+	light_block.Ls = light.Ls;
+	light_block.lightPosition_worldspace = light.lightPosition_worldspace;
+	light_block.power = light.power;
+	uniformBuffer->write(lightBlockOffset, light_block);
+
+	renderQueue->writeMaterials();
+	uniformBuffer->upload();
+
+	// Both stay bound for the whole frame, only the material range changes between draws
+	uniformBuffer->bindRange(FRAME_BLOCK_BINDING, frameBlockOffset, sizeof(frameBlock));
+	uniformBuffer->bindRange(LIGHT_BLOCK_BINDING, lightBlockOffset, sizeof(lightBlock));
+}
+
+// The defines of the lighting shader for a material of the render queue. The material paths of
+// ShadowMapping.fragmentshader and the output of the OIT pass are compiled in, not branched on
+shaderDefines lightingDefines(int material, bool oit_pass) {
+	const renderMaterial& m = renderQueue->material(material);
+	return {
+		{ "USE_TEXTURE", m.use_texture },
+		{ "USE_TRANSPARENCY", m.use_transparency },
+		{ "OIT_PASS", oit_pass ? 1 : 0 } };
+}
+
+GLuint lightingProgram(int material, bool oit_pass) {
+	return shadowMapVariants->program(lightingDefines(material, oit_pass));
+}
+
+// Creates the coin rain with the backend that was selected at compile time
+IntParticleEmitter* createCoinRainEmitter() {
+#ifdef USE_GPU_COIN_RAIN
+	return new GPUCoinRainEmitter(NUM_COINS);
+#else
+	CoinRainEmitter* emitter = new CoinRainEmitter(NUM_COINS);
+	emitter->collision_mesh = sceneCollision;
+	return emitter;
+#endif // USE_GPU_COIN_RAIN
+}
+
+// The renderer that goes with the emitter of createCoinRainEmitter
+ParticleRenderer* createCoinRainRenderer() {
+#ifdef USE_GPU_COIN_RAIN
+	return new GPUCoinRainRenderer(coin, coinRainUpdateProgram);
+#else
+	return new ParticleRenderer(coin);
+#endif // USE_GPU_COIN_RAIN
 }
 
 // Function that generates a Bezier Curve
@@ -229,82 +352,76 @@ glm::vec3 bezier_pos(float t, std::vector<glm::vec3> control_points) {
 
 void createContext()
 {
+    // The asset loads are in the startup frame of the trace
+    ProfileScope scope("createContext");
+
+    // Linked programs are kept here between runs, only the changed shaders are compiled again
+    setShaderCacheDirectory("ShaderCache");
+
     // Create and compile our GLSL program from the shaders
-    shadowMapShaderProgram = loadShaders(
+    // (the variants of the lighting shader are compiled after the materials, in one batch)
+    shadowMapVariants = new ShaderVariants(
         "Shaders/shadowMap-shaders/ShadowMapping.vertexshader",
         "Shaders/shadowMap-shaders/ShadowMapping.fragmentshader");
 
-    depthProgram = loadShaders(
-        "Shaders/depth-shaders/Depth.vertexshader",
-        "Shaders/depth-shaders/Depth.fragmentshader");
-
-	coinRainShaderProgram = loadShaders(
-        "Shaders/particles-shaders/coinRain.vertexshader",
-        "Shaders/particles-shaders/coinRain.fragmentshader");
-
-	blueSmokeShaderProgram = loadShaders(
-        "Shaders/particles-shaders/blueSmoke.vertexshader",
-        "Shaders/particles-shaders/blueSmoke.fragmentshader");
-
-    // --- shadowMapShaderProgram ---
-    // Model P-V-M Matrixes as uniform variables
-    projectionMatrixLocation = glGetUniformLocation(shadowMapShaderProgram, "P");
-    viewMatrixLocation = glGetUniformLocation(shadowMapShaderProgram, "V");
-    modelMatrixLocation = glGetUniformLocation(shadowMapShaderProgram, "M");
-
-	// PlaneCoeffs
-	planeLocation = glGetUniformLocation(shadowMapShaderProgram, "planeCoeffs");
-
-    // Model Materials as uniform variables
-    KaLocation = glGetUniformLocation(shadowMapShaderProgram, "mtl.Ka");
-	KdLocation = glGetUniformLocation(shadowMapShaderProgram, "mtl.Kd");
-	KsLocation = glGetUniformLocation(shadowMapShaderProgram, "mtl.Ks");
-	NsLocation = glGetUniformLocation(shadowMapShaderProgram, "mtl.Ns");
-
-    // Light Properties as uniform variables
-    LaLocation = glGetUniformLocation(shadowMapShaderProgram, "light.La");
-	LdLocation = glGetUniformLocation(shadowMapShaderProgram, "light.Ld");
-	LsLocation = glGetUniformLocation(shadowMapShaderProgram, "light.Ls");
-
-    // Light Position-Power as uniform variables
-    lightPositionLocation = glGetUniformLocation(shadowMapShaderProgram, "light.lightPosition_worldspace");
-    lightPowerLocation = glGetUniformLocation(shadowMapShaderProgram, "light.power");
-
-	// Textures
-	albedoColorSampler = glGetUniformLocation(shadowMapShaderProgram, "albedoColorSampler");
-	roughnessColorSampler = glGetUniformLocation(shadowMapShaderProgram, "roughnessColorSampler");
-	metallicColorSampler = glGetUniformLocation(shadowMapShaderProgram, "metallicColorSampler");
-	
-	// If useTexture = 0, use material
-	// If useTexture = 1, use texture
-	// If useTexture = 2, use texture for the Djinn
-	// If useTexture = 2, use texture for the clouds
-	useTextureLocation = glGetUniformLocation(shadowMapShaderProgram, "useTexture"); 
-
-	// We are sending the alpha value, and
-	// If useTransparency = 0 use the transparency that is given
-	// If useTransparency = 1 change the transparency of the Djinn
-	alphaLocation = glGetUniformLocation(shadowMapShaderProgram, "alpha");
-	transparencyLocation = glGetUniformLocation(shadowMapShaderProgram, "useTransparency");
-
-    // Shadow Rendering
-    depthMapSampler = glGetUniformLocation(shadowMapShaderProgram, "shadowMapSampler");
-
-    // Light View-Projection Matrixes
-    lightVPLocation = glGetUniformLocation(shadowMapShaderProgram, "lightVP");
-
-    // --- depthProgram ---
-	shadowViewProjectionLocation = glGetUniformLocation(depthProgram, "VP");
-	shadowModelLocation = glGetUniformLocation(depthProgram, "M");
+#ifdef USE_GPU_COIN_RAIN
+	// The GPU backend reads the instance positions straight from its state buffer
+	const char* coinRainVertexShader = "Shaders/particles-shaders/coinRainGPU.vertexshader";
+
+	coinRainUpdateProgram = loadTransformFeedbackShader(
+		"Shaders/particles-shaders/coinRainUpdate.vertexshader",
+		{ "tf_position", "tf_mass", "tf_velocity", "tf_life", "tf_respawns" });
+#else
+	const char* coinRainVertexShader = "Shaders/particles-shaders/coinRain.vertexshader";
+#endif // USE_GPU_COIN_RAIN
+
+	// Compiled together, in parallel when the driver supports it
+	std::vector<GLuint> programs = loadShaderBatch({
+		{ "Shaders/depth-shaders/Depth.vertexshader", "Shaders/depth-shaders/Depth.fragmentshader" },
+		{ coinRainVertexShader, "Shaders/particles-shaders/coinRain.fragmentshader" },
+		{ "Shaders/particles-shaders/blueSmoke.vertexshader", "Shaders/particles-shaders/blueSmoke.fragmentshader" },
+		{ "Shaders/oit-shaders/oitComposite.vertexshader", "Shaders/oit-shaders/oitComposite.fragmentshader" } });
+	depthProgram = programs[0];
+	coinRainShaderProgram = programs[1];
+	blueSmokeShaderProgram = programs[2];
+	oitCompositeProgram = programs[3];
+
+    // --- Uniform blocks ---
+    // V, P and lightVP (FrameData), the light (LightData) and the materials (MaterialData)
+    uniformBuffer = new UniformBufferAllocator();
+    frameBlockOffset = uniformBuffer->allocate(sizeof(frameBlock));
+    lightBlockOffset = uniformBuffer->allocate(sizeof(lightBlock));
+    UniformBufferAllocator::bindBlock(depthProgram, "FrameData", FRAME_BLOCK_BINDING);
+    // The particle programs are bound by ParticleSystem::addEmitter
+
+	// The plane that the transparency of the Djinn is measured from
+	planeNormal = vec3(vec4(0, 1, 0, 0));
+	float d = -dot(planeNormal, vec3(5,5,0));
+	planeCoeffs = vec4(planeNormal, d);
+
+    // --- shadowMapVariants ---
+    // M and the textures are set by the render queue, the rest doesn't change after creation
+	shadowMapVariants->onCreate = [](GLuint program) {
+		UniformBufferAllocator::bindBlock(program, "FrameData", FRAME_BLOCK_BINDING);
+		UniformBufferAllocator::bindBlock(program, "LightData", LIGHT_BLOCK_BINDING);
+		UniformBufferAllocator::bindBlock(program, "MaterialData", MATERIAL_BLOCK_BINDING);
+
+		glUseProgram(program);
+		// Shadow Rendering
+		glUniform1i(glGetUniformLocation(program, "shadowMapSampler"), 0);
+		glUniform4f(glGetUniformLocation(program, "planeCoeffs"), planeCoeffs.x, planeCoeffs.y, planeCoeffs.z, planeCoeffs.w);
+	};
 
-	// --- Particle Programs ---
-	projectionAndViewMatrix = glGetUniformLocation(coinRainShaderProgram, "PV");
-	projectionAndViewMatrix = glGetUniformLocation(blueSmokeShaderProgram, "PV");
+	// The maps are only queued here, their arrays are created before the materials
+	materialTextures = new TextureArrays();
+	TextureManager::instance().setBudget(TEXTURE_BUDGET_BYTES);
+	textureStreamer = new TextureStreamer();
+	TextureManager::instance().setStreamer(textureStreamer);
 
 	// Djinn
 	djinnMesh = new Model("OBJs/Djinn.obj");
 
-	djinnAlbedoTexture = loadSOIL("Textures/djinn/albedo.png");
+	djinnAlbedoTexture = materialTextures->add("Textures/djinn/albedo.png");
 
 	// Sizes of the walls, floor and the roof
 	float size1 = 8.0f;
@@ -382,8 +499,8 @@ void createContext()
 	wall4 = new Drawable(wallVertices4, wallUVs, wallNormals);
 	wall5 = new Drawable(wallVertices5, wallUVs, wallNormals);
 
-	wallAlbedoTexture = loadSOIL("Textures/wall/t3/albedo.jpg");
-	wallRoughnessTexture = loadSOIL("Textures/wall/t2/roughness.jpg");
+	wallAlbedoTexture = materialTextures->add("Textures/wall/t3/albedo.jpg");
+	wallRoughnessTexture = materialTextures->add("Textures/wall/t2/roughness.jpg");
 
 	// ------------------------- FLOOR ---------------
 	// Floor Vertices
@@ -415,36 +532,121 @@ void createContext()
 	};
 	gfloor = new Drawable(floorVertices, floorUVs, floorNormals);
 
-	floorAlbedoTexture = loadSOIL("Textures/floor/t4/albedo.jpg");
-	floorRoughnessTexture = loadSOIL("Textures/floor/t4/roughness.jpg");
+	floorAlbedoTexture = materialTextures->add("Textures/floor/t4/albedo.jpg");
+	floorRoughnessTexture = materialTextures->add("Textures/floor/t4/roughness.jpg");
 
     // Lamp
     lamp = new Drawable("OBJs/genie_lamp.obj");
 
-	lampAlbedoTexture = loadSOIL("Textures/gold/1/albedo.png");
-	lampMetallicTexture = loadSOIL("Textures/gold/1/metallic.png");
-	lampRoughnessTexture = loadSOIL("Textures/gold/1/roughness.png");
+	lampAlbedoTexture = materialTextures->add("Textures/gold/1/albedo.png");
+	lampMetallicTexture = materialTextures->add("Textures/gold/1/metallic.png");
+	lampRoughnessTexture = materialTextures->add("Textures/gold/1/roughness.png");
 
 	// Table
 	table = new Drawable("OBJs/table.obj");
 
-	tableAlbedoTexture = loadSOIL("Textures/table/albedo.png");
-	tableRoughnessTexture = loadSOIL("Textures/table/roughness.png");
+	tableAlbedoTexture = materialTextures->add("Textures/table/albedo.png");
+	tableRoughnessTexture = materialTextures->add("Textures/table/roughness.png");
 
 	// Rain of Coins
 	coin = new Drawable("OBJs/coin.obj");
-	coinDiffuceColorSampler = glGetUniformLocation(coinRainShaderProgram, "texture1");
-    coinColor = loadSOIL("Textures/gold/1/albedo.png");;
 
 	// Smoke from the tip of the genie lamp
 	smoke = new Drawable("OBJs/quad.obj");
-	smokeDiffuceColorSampler = glGetUniformLocation(blueSmokeShaderProgram, "texture2");
-    smokeTexture = loadSOIL("Textures/blue_smoke.png");
+	smokeTexture = TextureManager::instance().acquire("Textures/blue_smoke.png");
 
 	// Clouds
 	clouds = new Drawable("OBJs/clouds.obj");
-    cloudAlbedoTexture = loadSOIL("Textures/cloud/albedo1.png");
-	cloudRoughnessTexture = loadSOIL("Textures/cloud/roughness.png");
+	cloudAlbedoTexture = materialTextures->add("Textures/cloud/albedo1.png");
+	cloudRoughnessTexture = materialTextures->add("Textures/cloud/roughness.png");
+
+	// Every material map in as few texture arrays as the sizes allow
+	materialTextures->build();
+
+	// Materials of the render queue
+	// If useTexture = 0, use material
+	// If useTexture = 1, use texture
+	// If useTexture = 2, use texture for the walls
+	// If useTexture = 3, use texture for the clouds
+	// If useTransparency = 0 use the alpha that is given
+	// If useTransparency = 1 change the transparency of the Djinn
+	renderQueue = new RenderQueue(*uniformBuffer);
+	renderMaterial material;
+	material.albedo = materialTextures->layer(lampAlbedoTexture);
+	material.roughness = materialTextures->layer(lampRoughnessTexture);
+	material.metallic = materialTextures->layer(lampMetallicTexture);
+	material.use_texture = 1;
+	lampMaterial = renderQueue->addMaterial(material);
+
+	material = renderMaterial();
+	material.albedo = materialTextures->layer(tableAlbedoTexture);
+	material.roughness = materialTextures->layer(tableRoughnessTexture);
+	material.use_texture = 1;
+	tableMaterial = renderQueue->addMaterial(material);
+
+	material.albedo = materialTextures->layer(floorAlbedoTexture);
+	material.roughness = materialTextures->layer(floorRoughnessTexture);
+	floorMaterial = renderQueue->addMaterial(material);
+
+	material.albedo = materialTextures->layer(wallAlbedoTexture);
+	material.roughness = materialTextures->layer(wallRoughnessTexture);
+	material.use_texture = 2;
+	wallMaterial = renderQueue->addMaterial(material);
+
+	material.albedo = materialTextures->layer(cloudAlbedoTexture);
+	material.roughness = materialTextures->layer(cloudRoughnessTexture);
+	material.use_texture = 3;
+	cloudMaterial = renderQueue->addMaterial(material); // alpha is set every frame
+
+	material = renderMaterial();
+	material.albedo = materialTextures->layer(djinnAlbedoTexture);
+	material.use_texture = 1;
+	material.use_transparency = 1;
+	djinnMaterial = renderQueue->addMaterial(material);
+
+	material = renderMaterial();
+	material.albedo = materialTextures->layer(lampAlbedoTexture); // the same layer as the rain
+	material.roughness = materialTextures->layer(lampRoughnessTexture);
+	material.metallic = materialTextures->layer(lampMetallicTexture);
+	material.use_texture = 1;
+	coinMaterial = renderQueue->addMaterial(material);
+
+	// Every variant of the lighting shader that the materials use, the transparent ones with both outputs
+	std::vector<shaderDefines> variants;
+	for (int m : { lampMaterial, tableMaterial, floorMaterial, wallMaterial, coinMaterial }) {
+		variants.push_back(lightingDefines(m, false));
+	}
+	for (int m : { cloudMaterial, djinnMaterial }) {
+		variants.push_back(lightingDefines(m, false));
+		variants.push_back(lightingDefines(m, true));
+	}
+	shadowMapVariants->preload(variants);
+
+	// Coins lying flat around the lamp, in a few layers that get sparser towards the top
+	coinPile = new InstancedDrawable(coin);
+	float tableTop = -0.51f;
+	float coinThickness = 0.043f;
+	for (int i = 0; i < NUM_TABLE_COINS; i++) {
+		vec3 position(-3.2f + 4.4f * RAND, 0.0f, 0.6f + 1.8f * RAND);
+		int layer = (int) (3.0f * RAND * RAND);
+		position.y = tableTop + coinThickness * (layer + 0.5f);
+		mat4 transform = translate(mat4(1.0f), position) *
+			rotate(mat4(1.0f), 6.283f * RAND, vec3(0.0f, 1.0f, 0.0f)) *
+			rotate(mat4(1.0f), radians(90.0f), vec3(1.0f, 0.0f, 0.0f));
+		coinPile->addInstance(transform, coinMaterial);
+	}
+
+	// Collision geometry for the coins, with the same (static) model matrices that the scene is drawn with
+	sceneCollision = new CollisionMesh();
+	sceneCollision->addDrawable(*lamp, lampModelMatrix);
+	sceneCollision->addDrawable(*table, tableModelMatrix);
+	sceneCollision->addDrawable(*wall1, wall1ModelMatrix);
+	sceneCollision->addDrawable(*wall2, wall2ModelMatrix);
+	sceneCollision->addDrawable(*wall3, wall3ModelMatrix);
+	sceneCollision->addDrawable(*wall4, wall4ModelMatrix);
+	sceneCollision->addDrawable(*wall5, wall5ModelMatrix);
+	sceneCollision->addDrawable(*gfloor, floorModelMatrix);
+	sceneCollision->build();
 
 	// --- Depth Framebuffer and Texture (to store the depthmap) ---
     // Generate a Framebuffer
@@ -479,37 +681,64 @@ void createContext()
 	// Binding the default framebuffer
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	glfwSetKeyCallback(window, pollKeyboard);
+	shadowCache = new ShadowCache(SHADOW_WIDTH, SHADOW_HEIGHT);
+
+	// --- OIT targets, sized on the first frame that uses them ---
+	oit = new OITBuffer(oitCompositeProgram);
+	oit->target = sceneFrameBuffer;
 }
 
 void free()
 {
-    glDeleteProgram(shadowMapShaderProgram);
+	delete particles;
+	delete sceneCollision;
+	delete oit;
+	delete renderQueue;
+	delete materialTextures;
+	delete uniformBuffer;
+	delete coinPile;
+	delete shadowCache;
+	delete smokeFluid;
+	delete djinnMesh;
+	smokeTexture = TextureHandle();
+	TextureManager::instance().clear();
+	TextureManager::instance().setStreamer(nullptr);
+	delete textureStreamer;
+    delete shadowMapVariants;
     glDeleteProgram(depthProgram);
 	glDeleteProgram(coinRainShaderProgram);
 	glDeleteProgram(blueSmokeShaderProgram);
+	glDeleteProgram(oitCompositeProgram);
+#ifdef USE_GPU_COIN_RAIN
+	glDeleteProgram(coinRainUpdateProgram);
+#endif // USE_GPU_COIN_RAIN
+	Profiler::instance().clear();
+	if (ImGui::GetCurrentContext()) {
+		ImGui_ImplOpenGL3_Shutdown();
+		ImGui_ImplGlfw_Shutdown();
+		ImGui::DestroyContext();
+	}
+#ifdef DJINN_BENCH
+	delete offscreen;
+	offscreen = nullptr;
+#else
+	session.close();
+#endif // DJINN_BENCH
     glfwTerminate();
 }
 
-void depth_pass(mat4 viewMatrix, mat4 projectionMatrix) {
+// Collects the draw items of the frame, for both the depth and the lighting pass
+void submit_scene() {
+	renderQueue->beginFrame(camera->position);
 
-	// Setting viewport to shadow map size
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-
-	// Binding the depth framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthFrameBuffer);
-
-	// Cleaning the framebuffer depth information (stored from the last render)
-	glClear(GL_DEPTH_BUFFER_BIT);
-
-	// Selecting the new shader program that will output the depth component
-	glUseProgram(depthProgram);
-
-	// sending the view and projection matrix to the shader
-	mat4 view_projection = projectionMatrix * viewMatrix;
-	glUniformMatrix4fv(shadowViewProjectionLocation, 1, GL_FALSE, &view_projection[0][0]);
+	// Objects outside of the camera's frustum or the light's orthographic box are culled per pass
+	mat4 camera_vp = camera->projectionMatrix * camera->viewMatrix;
+	mat4 light_vp = light->lightVP();
+	renderQueue->setFrustum(STATIC_DEPTH_PASS, light_vp);
+	renderQueue->setFrustum(DEPTH_PASS, light_vp);
+	renderQueue->setFrustum(OPAQUE_PASS, camera_vp);
+	renderQueue->setFrustum(TRANSPARENT_PASS, camera_vp);
 
-	// ---- rendering the scene ---- //
 	// LAMP
 	lampModelMatrix = mat4(1.0f);
 
@@ -525,270 +754,114 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix) {
 		lampModelMatrix *= translate(mat4(1.0f), vec3(-0.9f, -0.05f, 0)) * rotationX * rotationZ * translate(mat4(1.0f), vec3(0.9f, 0.05f, 0));
     }
 
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &lampModelMatrix[0][0]);
-	lamp->bind();
-	lamp->draw();
-
-	// TABLE
-	tableModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &tableModelMatrix[0][0]);
-	table->bind();
-	table->draw();
-
-	// WALLS
-	wall1ModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &wall1ModelMatrix[0][0]);
-	wall1->bind();
-	wall1->draw();
-
-	wall2ModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &wall2ModelMatrix[0][0]);
-	wall2->bind();
-	wall2->draw();
-
-	wall3ModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &wall3ModelMatrix[0][0]);
-	wall3->bind();
-	wall3->draw();
-
-	wall4ModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &wall4ModelMatrix[0][0]);
-	wall4->bind();
-	wall4->draw();
-
-	wall5ModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &wall4ModelMatrix[0][0]);
-	wall5->bind();
-	wall5->draw();
-
-	// FLOOR
-	floorModelMatrix = mat4(1.0f);
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &floorModelMatrix[0][0]);
-	gfloor->bind();
-	gfloor->draw();
+	// The static objects keep their model matrices, the walls and the roof share one material.
+	// The trembling lamp is the only one that moves, it stays out of the shadow cache meanwhile
+	struct { Drawable* drawable; mat4* modelMatrix; int material; } opaque_objects[] = {
+		{ lamp, &lampModelMatrix, lampMaterial },
+		{ table, &tableModelMatrix, tableMaterial },
+		{ gfloor, &floorModelMatrix, floorMaterial },
+		{ wall1, &wall1ModelMatrix, wallMaterial },
+		{ wall2, &wall2ModelMatrix, wallMaterial },
+		{ wall3, &wall3ModelMatrix, wallMaterial },
+		{ wall4, &wall4ModelMatrix, wallMaterial },
+		{ wall5, &wall5ModelMatrix, wallMaterial },
+	};
+	for (auto& object : opaque_objects) {
+		renderPass shadow_pass = object.drawable == lamp && tremble_action ? DEPTH_PASS : STATIC_DEPTH_PASS;
+		renderQueue->submit(shadow_pass, depthProgram, -1, object.drawable, *object.modelMatrix);
+		renderQueue->submit(OPAQUE_PASS, lightingProgram(object.material, false), object.material, object.drawable, *object.modelMatrix);
+	}
+
+	// COIN PILE, the instances are placed on the table
+	if (show_coin_pile) {
+		renderQueue->submit(STATIC_DEPTH_PASS, depthProgram, -1, coinPile, tableModelMatrix);
+		renderQueue->submit(OPAQUE_PASS, lightingProgram(coinMaterial, false), coinMaterial, coinPile, tableModelMatrix);
+	}
 
+	// CLOUDS, they slowly stop being transparent
 	if (coin_rain) {
-		glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &cloudsModelMatrix[0][0]);
+		renderQueue->material(cloudMaterial).alpha = cloudTransparency;
+		renderQueue->submit(DEPTH_PASS, depthProgram, -1, clouds, cloudsModelMatrix);
+		renderQueue->submit(TRANSPARENT_PASS, lightingProgram(cloudMaterial, use_oit), cloudMaterial, clouds, cloudsModelMatrix);
 
-		clouds->bind();
-		clouds->draw();
+		if (start_cloud_transparency) {
+			cloudTransparency += 0.001f;
+		}
 	}
 
+	// DJINN
 	if (blue_smoke) {
-		glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &djinnModelMatrix[0][0]);
-		djinnMesh->draw();
+		renderQueue->material(djinnMaterial).alpha = djinnTransparency;
+		renderQueue->submit(DEPTH_PASS, depthProgram, -1, djinnMesh, djinnModelMatrix);
+		renderQueue->submit(TRANSPARENT_PASS, lightingProgram(djinnMaterial, use_oit), djinnMaterial, djinnMesh, djinnModelMatrix);
 	}
-
-	// binding the default framebuffer again
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix) {
+void depth_pass() {
+	GPUProfileScope scope("depth pass");
 
-	// Step 1: Binding a frame buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, 2 * W_WIDTH, 2 * W_HEIGHT);
+	// Setting viewport to shadow map size
+	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
-	// Step 2: Clearing color and depth info
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// Selecting the new shader program that will output the depth component
+	glUseProgram(depthProgram);
 
-	// Step 3: Selecting shader program
-	glUseProgram(shadowMapShaderProgram);
+	// The light's view-projection matrix comes from the FrameData block
 
-	// Making view and projection matrices uniform to the shader program
-	glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-	glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+	// ---- rendering the scene ---- //
+	// The static casters are drawn only when the light or one of them moved
+	if (shadowCache->begin(light->lightVP(), renderQueue->signature(STATIC_DEPTH_PASS))) {
+		renderQueue->flush(STATIC_DEPTH_PASS);
+	}
 
-	// uploading the light parameters to the shader program
-	uploadLight(*light);
+	// The cached depth replaces the clear of the depth framebuffer, the dynamic casters go on top
+	shadowCache->copyTo(depthFrameBuffer);
+	renderQueue->flush(DEPTH_PASS);
 
-	// Sending the shadow texture to the shaderProgram
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	glUniform1i(depthMapSampler, 0);
+	// binding the scene's framebuffer again
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
+}
 
-	// Sending the light View-Projection matrix to the shader program
-	mat4 light_vp = light->lightVP();
-	glUniformMatrix4fv(lightVPLocation, 1, GL_FALSE, &light_vp[0][0]);
-
-	// ------------------------------- Drawing scene objects ------------------------------- //	
-	// ------------------------- LAMP (TEXTURES 1,2,3)
-
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &lampModelMatrix[0][0]);
-    // Albedo
-    glActiveTexture(GL_TEXTURE1);								
-	glBindTexture(GL_TEXTURE_2D, lampAlbedoTexture);		 
-	glUniform1i(albedoColorSampler, 1);		
-	// Metallic
-	glActiveTexture(GL_TEXTURE2);						
-	glBindTexture(GL_TEXTURE_2D, lampMetallicTexture);		
-	glUniform1i(metallicColorSampler, 2);	
-	// Roughness
-	glActiveTexture(GL_TEXTURE3);							
-	glBindTexture(GL_TEXTURE_2D, lampRoughnessTexture);	
-	glUniform1i(roughnessColorSampler, 3);
-
-	/* Inside the fragment shader, there is an if statement
-	whether to use the material of an object or sample a texture */
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 1);
-
-	lamp->bind();
-	lamp->draw();
-
-	// ---------------------------- TABLE (TEXTURES 4,5)
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &tableModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE4);							
-	glBindTexture(GL_TEXTURE_2D, tableAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 4);					
-	glActiveTexture(GL_TEXTURE5);												
-	glBindTexture(GL_TEXTURE_2D, tableRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 5);	
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 1);
-	table->bind();
-	table->draw();
-
-	// ---------------------------- FLOOR (TEXTURES 6,7)
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &floorModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE6);							
-	glBindTexture(GL_TEXTURE_2D, floorAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 6);					
-	glActiveTexture(GL_TEXTURE7);					
-	glBindTexture(GL_TEXTURE_2D, floorRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 7);	
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 1);
-	gfloor->bind();
-	gfloor->draw();
-
-	// ---------------------------- FLOOR (TEXTURES 8,9,10,11,12,13,14,15)
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &wall1ModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE8);							
-	glBindTexture(GL_TEXTURE_2D, wallAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 8);					
-	glActiveTexture(GL_TEXTURE9);					
-	glBindTexture(GL_TEXTURE_2D, wallRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 9);
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 2);
-	wall1->bind();
-	wall1->draw();
-
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &wall2ModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE10);							
-	glBindTexture(GL_TEXTURE_2D, wallAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 10);					
-	glActiveTexture(GL_TEXTURE11);					
-	glBindTexture(GL_TEXTURE_2D, wallRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 11);
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 2);
-	wall2->bind();
-	wall2->draw();
-
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &wall3ModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE12);							
-	glBindTexture(GL_TEXTURE_2D, wallAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 12);					
-	glActiveTexture(GL_TEXTURE13);					
-	glBindTexture(GL_TEXTURE_2D, wallRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 13);
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 2);
-	wall3->bind();
-	wall3->draw();
-
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &wall4ModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE14);							
-	glBindTexture(GL_TEXTURE_2D, wallAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 14);					
-	glActiveTexture(GL_TEXTURE15);					
-	glBindTexture(GL_TEXTURE_2D, wallRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 15);
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 2);
-	wall4->bind();
-	wall4->draw();
-
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &wall4ModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE16);							
-	glBindTexture(GL_TEXTURE_2D, wallAlbedoTexture);		
-	glUniform1i(albedoColorSampler, 16);					
-	glActiveTexture(GL_TEXTURE17);					
-	glBindTexture(GL_TEXTURE_2D, wallRoughnessTexture);		
-	glUniform1i(roughnessColorSampler, 17);
-
-	glUniform1f(alphaLocation, 1.0f);
-	glUniform1i(transparencyLocation, 0);
-	glUniform1i(useTextureLocation, 2);
-	wall5->bind();
-	wall5->draw();
+void transparent_objects();
 
-	if (coin_rain) {
-		// ---------------------------- CLOUDS (TEXTURES 16,17)
-		mat4 cloudsModelMatrix = mat4(1.0f);
-		glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &cloudsModelMatrix[0][0]);
-
-		glActiveTexture(GL_TEXTURE18);						
-		glBindTexture(GL_TEXTURE_2D, cloudAlbedoTexture);		
-		glUniform1i(albedoColorSampler, 18);
-		glActiveTexture(GL_TEXTURE19);						
-		glBindTexture(GL_TEXTURE_2D, cloudRoughnessTexture);		
-		glUniform1i(roughnessColorSampler, 19);
-
-		glUniform1f(alphaLocation, cloudTransparency);
-		glUniform1i(transparencyLocation, 0);
-		glUniform1i(useTextureLocation, 3);
-		clouds->bind();
-		clouds->draw();
+void lighting_pass() {
+	GPUProfileScope scope("lighting pass");
 
-		if (start_cloud_transparency) {
-			cloudTransparency += 0.001f;	
-		}	
-	}
+	// Step 1: Binding a frame buffer
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFrameBuffer);
+	glViewport(0, 0, sceneWidth, sceneHeight);
 
-	if (blue_smoke) {
-		// ---------------------------- DJINN (TEXTURES 18)
-		glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &djinnModelMatrix[0][0]);
+	// Step 2: Clearing color and depth info
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glActiveTexture(GL_TEXTURE20);						
-		glBindTexture(GL_TEXTURE_2D, djinnAlbedoTexture);		
-		glUniform1i(albedoColorSampler, 20);
+	// Step 3: The render queue selects the variant of the lighting shader for every material
+	// The view, projection and light matrices and the light are in the FrameData and LightData blocks
 
-		planeNormal = vec3(vec4(0, 1, 0, 0));
-		float d = -dot(planeNormal, vec3(5,5,0));
-		planeCoeffs = vec4(planeNormal, d);
+	// Sending the shadow texture to the shaderProgram (unit 0, set when the variant was created)
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
 
-		glUniform4f(planeLocation, planeCoeffs.x, planeCoeffs.y, planeCoeffs.z, planeCoeffs.w);				
+	// ------------------------------- Drawing scene objects ------------------------------- //
+	renderQueue->flush(OPAQUE_PASS);
 
-		glUniform1f(alphaLocation, djinnTransparency);
-		glUniform1i(transparencyLocation, 1);
-		glUniform1i(useTextureLocation, 1);
-		djinnMesh->draw();
+	// With OIT they are drawn after the particles, into the accumulation targets
+	if (!use_oit) {
+		transparent_objects();
 	}
 }
 
+// The objects that are drawn with alpha: the clouds and the Djinn.
+// With OIT they were submitted with the OIT_PASS variant, which writes the accumulation targets
+void transparent_objects() {
+	// Inside the lighting pass (without OIT) it is only timed on the CPU, GPU scopes don't nest
+	GPUProfileScope scope("transparent objects");
+	// The particles may have used texture unit 0 since the lighting pass
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+
+	renderQueue->flush(TRANSPARENT_PASS);
+}
+
 float computeTransparency(float progress) {
     float transparency;
     if (progress < 0.5f) {
@@ -800,127 +873,299 @@ float computeTransparency(float progress) {
     return transparency;
 }
 
-void mainLoop()
+// Advances everything that moves by the time of the frame, in fixed steps. Returns the position
+// of the frame between the last two simulated states
+float simulateFrame(float frame_dt)
 {
-    light->update();
-	mat4 light_proj = light->projectionMatrix;
-	mat4 light_view = light->viewMatrix;
+	simClock.beginFrame(frame_dt);
+	TextureManager::instance().beginFrame();
+	textureStreamer->update(TEXTURE_UPLOAD_BUDGET_MS);
+
+	// Rain of coins
+	IntParticleEmitter* r_emitter = particles->emitter(coinRainEmitterId);
+	r_emitter->emitter_pos = rain_emitter_pos;
+	r_emitter->use_rotations = use_rotations;
+	r_emitter->use_billboards = use_billboards;
+	r_emitter->use_sorting = use_sorting && !use_oit;
+	particles->entry(coinRainEmitterId).enabled = coin_rain;
 
-	camera->position = vec3(0, 3, 8);
-	camera->verticalAngle = -0.33f;
-
-	r_emitter = new CoinRainEmitter(coin, NUM_COINS);
-	s_emitter = new SmokeEmitter(smoke, NUM_PARTICLES);
-
-	float progress = 0.0f;
-	float counter = 0.0f;
-	float thickness_factor = 0.0f;
-
-	float t = glfwGetTime();
-	
-	do
+	// Smoke from the tip of the genie lamp
+	SmokeEmitter* s_emitter = (SmokeEmitter*) particles->emitter(smokeEmitterId);
+	s_emitter->emitter_pos = smoke_emitter_pos;
+	s_emitter->use_rotations = use_rotations;
+	s_emitter->use_billboards = use_billboards;
+	s_emitter->use_sorting = use_sorting && !use_oit; // OIT doesn't depend on the draw order
+	s_emitter->height_threshold = height_threshold;
+	s_emitter->fluid = use_smoke_fluid ? smokeFluid : nullptr;
+	particles->entry(smokeEmitterId).enabled = blue_smoke;
+
+	// Everything that moves is advanced in fixed steps, the frame only decides how many
 	{
-		light->update();
-        mat4 light_proj = light->projectionMatrix;
-        mat4 light_view = light->viewMatrix;
+		ProfileScope scope("simulation");
+		while (simClock.step()) {
+			float dt = simClock.fixed_dt;
+
+			light->update();
+
+			// DJINN (comes out together with the blue smoke)
+			previous_thickness_factor = thickness_factor;
+			if (blue_smoke) {
+				djinn_counter += 0.01f;
+
+				vec3 p0(0.0f, 0.0f, 0.0f);
+				vec3 p1(0.0f, 2.0f, 0.0f);
+				vec3 p2(5.0f, 2.0f, 0.0f);
+				vec3 p3(5.0f, 5.0f, 0.0f);
+				std::vector<glm::vec3> control_points = generateBezierCurve(10, p0, p1, p2, p3);
+
+				// Update the djinn's position
+				if (djinn_progress < 1.0f && djinn_counter < 5.0f)
+				{
+					djinn_progress += dt * djinn_counter;
+			
+					djinn_translation = bezier_pos(djinn_progress, control_points);
+					thickness_factor = length(bezier_pos(djinn_progress, control_points)) / length(p3);
+					djinnTransparency = computeTransparency(djinn_progress);
+				}
+
+				// If the djinn pops, stop the trembling
+				if (djinn_translation.x > 4.5f) {
+					tremble_action = false;
+				}
+			}
 
-        depth_pass(light_view, light_proj);
+			// COIN RAIN and BLUE SMOKE: one parallel update of the enabled emitters
+			if(!game_paused) {
+				if (blue_smoke && use_smoke_fluid) {
+					// The stages of the solver are rows of the profiler overlay
+					ProfileScope scope("smoke fluid");
+					smokeFluid->step<ProfileScope>(dt);
+				}
+				particles->updateParticles(simClock.time, dt, camera->position);
+			}
+		}
+	}
 
-        // Getting Camera Information
-        camera->update();
-        mat4 projectionMatrix = camera->projectionMatrix;
-        mat4 viewMatrix = camera->viewMatrix;
+	return simClock.alpha();
+}
 
-		float currentTime = glfwGetTime();
-		float dt = currentTime - t;
+// Draws the frame between the last two simulated states into sceneFrameBuffer
+void renderFrame(float alpha)
+{
+	mat4 projectionMatrix = camera->projectionMatrix;
+	mat4 viewMatrix = camera->viewMatrix;
 
-		// Render the scene from camera's perspective
-        lighting_pass(viewMatrix, projectionMatrix);
+	if (blue_smoke) {
+		float thickness = mix(previous_thickness_factor, thickness_factor, alpha);
+		djinn_scaling = vec3(thickness, thickness, thickness);
+		djinnModelMatrix = scale(mat4(1), djinn_scaling);
+	}
 
-		// Rain of coins
-		r_emitter->changeParticleNumber(NUM_COINS);
-		r_emitter->emitter_pos = rain_emitter_pos;
-		r_emitter->use_rotations = use_rotations;
-		r_emitter->use_sorting = use_sorting;
+	light->interpolate(alpha);
 
-		// Smoke from the tip of the genie lamp
-		s_emitter->changeParticleNumber(NUM_PARTICLES);
-		s_emitter->emitter_pos = smoke_emitter_pos;
-		s_emitter->use_rotations = use_rotations;
-		s_emitter->use_sorting = use_sorting;
-		s_emitter->height_threshold = height_threshold;
+	// The draws of both passes, sorted by the render queue
+	{
+		ProfileScope scope("submit scene");
+		submit_scene();
+	}
 
-		auto PV = projectionMatrix * viewMatrix;
+	// One uniform buffer update for the camera, the light and the materials of the frame
+	uploadFrameBlocks(viewMatrix, projectionMatrix, *light);
 
-		// COIN RAIN
-		glUseProgram(coinRainShaderProgram);
+	depth_pass();
 
-		glUniformMatrix4fv(projectionAndViewMatrix, 1, GL_FALSE, &PV[0][0]);
+	// Render the scene from camera's perspective
+	lighting_pass();
 
-		// Use particle based drawing
-		if (coin_rain) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, coinColor);
-			glUniform1i(coinDiffuceColorSampler, 0);
+	// Draw the particles of the enabled emitters.
+	// Their draws are timed by the particle system, so they aren't inside a GPU scope
+	if (use_oit) {
+		{
+			ProfileScope scope("particles");
+			particles->renderParticles(alpha, OPAQUE_PARTICLES);
+		}
 
-			if(!game_paused) {
-				r_emitter->updateParticles(currentTime, dt, camera->position);
-			}
-			r_emitter->renderParticles(0);
+		// Transparent surfaces in any order: clouds, Djinn and smoke
+		int width = sceneWidth, height = sceneHeight;
+		if (window) glfwGetFramebufferSize(window, &width, &height);
+		oit->begin(width, height);
+		transparent_objects();
+		{
+			ProfileScope scope("particles");
+			particles->renderParticles(alpha, TRANSPARENT_PARTICLES);
 		}
+		GPUProfileScope scope("oit composite");
+		oit->composite();
+	}
+	else {
+		ProfileScope scope("particles");
+		particles->renderParticles(alpha);
+	}
 
-		// BLUE SMOKE
-		glUseProgram(blueSmokeShaderProgram);
+	// Per pass timings, toggled with G
+	if (Profiler::instance().show_overlay) {
+		ProfileScope scope("overlay");
+		ImGui_ImplOpenGL3_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+		Profiler::instance().drawOverlay();
+		ImGui::Render();
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	}
+}
 
-		glUniformMatrix4fv(projectionAndViewMatrix, 1, GL_FALSE, &PV[0][0]);
+void mainLoop()
+{
+    light->update();
 
-		if (blue_smoke) {
-			counter += 0.01f;
+	camera->position = vec3(0, 3, 8);
+	camera->verticalAngle = -0.33f;
 
-			vec3 p0(0.0f, 0.0f, 0.0f);
-			vec3 p1(0.0f, 2.0f, 0.0f);
-			vec3 p2(5.0f, 2.0f, 0.0f);
-			vec3 p3(5.0f, 5.0f, 0.0f);
-			std::vector<glm::vec3> control_points = generateBezierCurve(10, p0, p1, p2, p3);
+	// The particle system draws the emitters in the order they are added
+	particles = new ParticleSystem();
+	particles->frame_budget_ms = PARTICLE_FRAME_BUDGET;
+	coinRainEmitterId = particles->addEmitter(createCoinRainEmitter(), createCoinRainRenderer(), coinRainShaderProgram, materialTextures->layer(lampAlbedoTexture), "texture1", NUM_COINS, "coin rain");
+	smokeEmitterId = particles->addEmitter(new SmokeEmitter(NUM_PARTICLES), new ParticleRenderer(smoke), blueSmokeShaderProgram, smokeTexture, "texture2", NUM_PARTICLES, "smoke");
+	particles->entry(smokeEmitterId).transparent = true;
+
+	particles->seed(simClock.seed);
+	// The budget follows the measured CPU and GPU times, which differ from run to run
+	particles->adaptive_budget = !simClock.deterministic;
+#ifndef DJINN_BENCH
+	// A replay takes the particle numbers of the recording
+	if (session.replaying()) particles->adaptive_budget = false;
+#endif // DJINN_BENCH
+
+	// The wind pushes the smoke towards the Djinn, like the curves of the particles do
+	smokeFluid = new SmokeFluidSolver(smoke_emitter_pos + vec3(-3.0f, -1.0f, -4.0f), smoke_emitter_pos + vec3(8.0f, 6.0f, 4.0f), SMOKE_FLUID_CELL);
+	smokeFluid->source_pos = smoke_emitter_pos;
+	smokeFluid->wind = vec3(1.5f, 0.0f, 0.0f);
+
+#ifdef DJINN_BENCH
+	// A fixed workload: every texture is there from the start, the deterministic clock turns the particle budget off.
+	// The script presses the keys and moves the camera (Bench.h)
+	textureStreamer->finish();
+	passed = runBench(benchSettings, *camera, *offscreen, simClock.fixed_dt,
+		[](int key) { pollKeyboard(window, key, 0, GLFW_PRESS, 0); },
+		[](float dt) { renderFrame(simulateFrame(dt)); });
+#else
+	float t = glfwGetTime();
+	float stats_time = t;
 
-			// Update the djinn's position
-			if (progress < 1.0f && counter < 5.0f)
-			{
-				progress += dt * counter;
-				
-				djinn_translation = bezier_pos(progress, control_points);
-				thickness_factor = length(bezier_pos(progress, control_points)) / length(p3);
-				djinnTransparency = computeTransparency(progress);
-			}
+	do
+	{
+		// The timings of the last frame go to the overlay, the GPU ones come a few frames later
+		Profiler::instance().beginFrame();
+		double frame_start = glfwGetTime();
+
+		// A replay takes the camera and the frame time of the trace instead of the input and the clock
+		sessionFrame session_frame;
+		if (session.replaying()) {
+			session_frame = session.nextFrame();
+			camera->position = session_frame.camera_position;
+			camera->horizontalAngle = session_frame.horizontal_angle;
+			camera->verticalAngle = session_frame.vertical_angle;
+			camera->FoV = session_frame.fov;
+			camera->updateMatrices();
+		}
+		else {
+			// Getting Camera Information
+			camera->update();
+			session_frame.camera_position = camera->position;
+			session_frame.horizontal_angle = camera->horizontalAngle;
+			session_frame.vertical_angle = camera->verticalAngle;
+			session_frame.fov = camera->FoV;
+		}
 
-			djinn_scaling = vec3(thickness_factor, thickness_factor, thickness_factor);
+		float currentTime = glfwGetTime();
+		float frame_dt = session.replaying() ? session_frame.dt : currentTime - t;
+		session_frame.dt = frame_dt;
+		t = currentTime;
 
-			// If the djinn pops, stop the trembling
-			if (djinn_translation.x > 4.5f) {
-				tremble_action = false;
+		// The adaptive budget follows the speed of the machine, a replay takes the numbers of the recording
+		for (int id = 0; id < particles->emitterCount(); id++) {
+			if (session.replaying() && id < session_frame.particle_numbers.size()) {
+				particles->emitter(id)->changeParticleNumber(session_frame.particle_numbers[id]);
 			}
-
-			djinnModelMatrix = scale(mat4(1), djinn_scaling);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, smokeTexture);
-			glUniform1i(smokeDiffuceColorSampler, 0);
-
-			if(!game_paused) {
-				s_emitter->updateParticles(currentTime, dt, camera->position);
+			else {
+				session_frame.particle_numbers.push_back(particles->emitter(id)->number_of_particles);
 			}
-			s_emitter->renderParticles(0);
 		}
 
-		t = currentTime;
+		float alpha = simulateFrame(frame_dt);
+
+		// The light of a replay doesn't read the keys, it is where it was in the recording
+		if (session.replaying()) {
+			light->previousPosition_worldspace = session_frame.light_previous_position;
+			light->lightPosition_worldspace = session_frame.light_position;
+		}
+		session_frame.light_previous_position = light->previousPosition_worldspace;
+		session_frame.light_position = light->lightPosition_worldspace;
+
+		renderFrame(alpha);
+
+		// Draw calls and state changes of the scene objects, in the title about once a second
+		if (currentTime - stats_time > 1.0f) {
+			const renderQueueStats& stats = renderQueue->stats();
+			int camera_submitted = stats.submitted[OPAQUE_PASS] + stats.submitted[TRANSPARENT_PASS];
+			int camera_culled = stats.culled[OPAQUE_PASS] + stats.culled[TRANSPARENT_PASS];
+			int light_submitted = stats.submitted[STATIC_DEPTH_PASS] + stats.submitted[DEPTH_PASS];
+			int light_culled = stats.culled[STATIC_DEPTH_PASS] + stats.culled[DEPTH_PASS];
+			string title = string(TITLE) + " - " + to_string(stats.draw_calls) + " draw calls (" + to_string(stats.instances) + " instances), " +
+				to_string(stats.program_binds) + " programs, " + to_string(stats.texture_binds) + " textures, " +
+				to_string(stats.vao_binds) + " VAOs, " + to_string(stats.uniform_updates) + " uniforms, " + to_string(stats.ubo_binds) + " material ranges, " +
+				to_string(stats.skipped_binds) + " redundant skipped, shadow cache " +
+				to_string(shadowCache->cache_hits) + "/" + to_string(shadowCache->cache_hits + shadowCache->rebuilds) + " frames, " +
+				"camera " + to_string(camera_submitted) + " drawn " + to_string(camera_culled) + " culled, " +
+				"light " + to_string(light_submitted) + " drawn " + to_string(light_culled) + " culled";
+			glfwSetWindowTitle(window, title.c_str());
+			stats_time = currentTime;
+		}
 
 		glfwPollEvents();
-        glfwSwapBuffers(window);
+		// The keys of the recording at the point where the window delivered them
+		if (session.replaying()) {
+			for (int key : session_frame.keys) pollKeyboard(window, key, 0, GLFW_PRESS, 0);
+		}
+		{
+			// Includes the wait for the vertical sync
+			ProfileScope scope("swap buffers");
+			glfwSwapBuffers(window);
+		}
+
+		float frame_ms = (float) ((glfwGetTime() - frame_start) * 1000.0);
+		if (session.replaying()) {
+			session.replayedFrame(frame_ms);
+		}
+		else {
+			session_frame.frame_ms = frame_ms;
+			session.writeFrame(session_frame);
+		}
 
 	} while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-			 glfwWindowShouldClose(window) == 0);
+			 glfwWindowShouldClose(window) == 0 &&
+			 !(session.replaying() && session.finished()));
+
+	// The frame times of the replay next to the recorded ones
+	if (session.replaying()) {
+		session.writeTimings(replayPath + ".csv");
+		session.report(cout);
+		cout << "Frame times written to " << replayPath << ".csv" << endl;
+	}
+#endif // DJINN_BENCH
 }
 
+#ifndef DJINN_BENCH
+// The keys of the window. They go into the recorded session; a replay takes its keys from the
+// trace, only the profiler keys (which don't change the scene) still come from the keyboard
+void onKey(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	bool profiler_key = key == GLFW_KEY_G || key == GLFW_KEY_T;
+	if (session.replaying() && !profiler_key) return;
+	if (session.recording() && action == GLFW_PRESS && !profiler_key) session.pressKey(key);
+	pollKeyboard(window, key, scancode, action, mods);
+}
+#endif // DJINN_BENCH
+
 void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 
     if (key == GLFW_KEY_P && action == GLFW_PRESS) {
@@ -933,14 +1178,52 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 
 	if (key == GLFW_KEY_2 && action == GLFW_PRESS) {
         blue_smoke = !blue_smoke;
-		s_emitter = new SmokeEmitter(smoke, NUM_PARTICLES);
+		particles->replaceEmitter(smokeEmitterId, new SmokeEmitter(NUM_PARTICLES));
 	}
 
 	if (key == GLFW_KEY_3 && action == GLFW_PRESS) {
         coin_rain = !coin_rain;
 		cloudTransparency = 0.0f;
 		start_cloud_transparency = true;
-		r_emitter = new CoinRainEmitter(coin, NUM_COINS);
+		particles->replaceEmitter(coinRainEmitterId, createCoinRainEmitter());
+	}
+
+	// Switch between the shader billboards and the CPU instance matrices
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		use_billboards = !use_billboards;
+	}
+
+	// Switch the smoke between its curves and the fluid solver, the particles start over
+	if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+		use_smoke_fluid = !use_smoke_fluid;
+		particles->replaceEmitter(smokeEmitterId, new SmokeEmitter(NUM_PARTICLES));
+	}
+
+	// Show or hide the pile of coins on the table
+	if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		show_coin_pile = !show_coin_pile;
+	}
+
+	// Switch between sorted alpha blending and order independent transparency
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		use_oit = !use_oit;
+	}
+
+	// Profiler overlay with the CPU and GPU time of every pass
+	if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		Profiler::instance().show_overlay = !Profiler::instance().show_overlay;
+	}
+
+	// Chrome trace of the startup and the last frames. This runs in the key callback of GLFW,
+	// an exception must not leave it
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		try {
+			Profiler::instance().writeChromeTrace(TRACE_PATH);
+			cout << "Trace written to " << TRACE_PATH << endl;
+		}
+		catch (exception& ex) {
+			cout << ex.what() << endl;
+		}
 	}
 
 	// // Release Button: It's setting the timer to 0.0f
@@ -963,6 +1246,13 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 
 void initialize()
 {
+#ifdef DJINN_BENCH
+    // No window: an EGL context without a surface, the scene is drawn into an offscreen framebuffer
+    offscreen = new OffscreenContext(W_WIDTH, W_HEIGHT);
+    sceneFrameBuffer = offscreen->frameBuffer();
+    sceneWidth = W_WIDTH;
+    sceneHeight = W_HEIGHT;
+#else
     // Initialize GLFW
     if (!glfwInit())
     {
@@ -1006,12 +1296,13 @@ void initialize()
     glfwPollEvents();
     glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
 
+    // Keyboard Inputs
+    glfwSetKeyCallback(window, onKey);
+#endif // DJINN_BENCH
+
     // Gray background color
     glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
 
-    // Keyboard Inputs
-    glfwSetKeyCallback(window, pollKeyboard);
-
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
     // Accept fragment if it closer to the camera than the former one
@@ -1028,7 +1319,16 @@ void initialize()
     // Log
     logGLParameters();
 
-    // Create camera
+#ifndef DJINN_BENCH
+    // ImGui draws the profiler overlay. It only shows timings, so it doesn't take the input callbacks
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui::GetIO().IniFilename = NULL;
+    ImGui_ImplGlfw_InitForOpenGL(window, false);
+    ImGui_ImplOpenGL3_Init("#version 330 core");
+#endif // DJINN_BENCH
+
+    // Create camera (without a window in djinn_bench, then it follows the script)
     camera = new Camera(window);
 
     // Creating a custom light 
@@ -1039,17 +1339,63 @@ void initialize()
 		vec3{ 0, 10, 10 },
 		150.0f
 	);
+#ifndef DJINN_BENCH
+	// The light of a replay is moved by the trace, not by the keys
+	if (session.replaying()) light->window = nullptr;
 
 	glfwSetCursorPosCallback(window, [](GLFWwindow* window, double xpos, double ypos) {
                                  camera->onMouseMove(xpos, ypos);
                              }
     );
+#endif // DJINN_BENCH
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+    // --deterministic [seed]: one fixed step per frame, seeded randomness and no particle budget, for reproducible runs
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--deterministic") {
+            simClock.deterministic = true;
+            if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+                simClock.seed = (unsigned int) stoul(argv[++i]);
+            }
+        }
+#ifdef DJINN_BENCH
+        // djinn_bench [--script file] [--frames N] [--out file] [--golden dir [--update-golden]]
+        else if (benchSettings.parse(argc, argv, i)) continue;
+#else
+        // --record file: writes the session, --replay file: plays it back and writes file.csv with the frame times
+        else if (string(argv[i]) == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (string(argv[i]) == "--replay" && i + 1 < argc) replayPath = argv[++i];
+#endif // DJINN_BENCH
+    }
+#ifdef DJINN_BENCH
+    // The same frames every run, the golden images depend on it
+    simClock.deterministic = true;
+#endif // DJINN_BENCH
+    srand(simClock.seed);
+
     try
     {
+#ifndef DJINN_BENCH
+        // A replay runs with the clock and the seed of the recording
+        if (!replayPath.empty()) {
+            session.replay(replayPath);
+            simClock.seed = session.header().seed;
+            simClock.deterministic = session.header().deterministic;
+            simClock.fixed_dt = session.header().fixed_dt;
+            simClock.max_substeps = session.header().max_substeps;
+            srand(simClock.seed);
+        }
+        else if (!recordPath.empty()) {
+            sessionHeader header;
+            header.seed = simClock.seed;
+            header.deterministic = simClock.deterministic;
+            header.fixed_dt = simClock.fixed_dt;
+            header.max_substeps = simClock.max_substeps;
+            session.record(recordPath, header);
+        }
+#endif // DJINN_BENCH
         initialize();
         createContext();
         mainLoop();
@@ -1058,10 +1404,13 @@ int main(void)
     catch (exception& ex)
     {
         cout << ex.what() << endl;
+#ifndef DJINN_BENCH
         getchar();
+#endif // DJINN_BENCH
         free();
         return -1;
     }
 
-    return 0;
+    // A golden frame that changed fails the run
+    return passed ? 0 : 1;
 }
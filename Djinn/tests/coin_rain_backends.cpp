@@ -0,0 +1,135 @@
+// Runs the CPU (CoinRainEmitter) and the GPU (GPUCoinRainEmitter) coin rain from one seed for the
+// same fixed steps and compares what comes out. Both backends integrate the same motion with the
+// same spawn rule but draw different random numbers, so only the distributions have to match:
+// the live count, the mean and variance of position.y and life, and the coins that died.
+//
+//   coin_rain_backends          (from the folder djinn, for the shader)
+//
+// The GPU side runs in an EGL surfaceless context, Mesa's llvmpipe is enough. Without one the
+// test is skipped (exit code 77).
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+#include <exception>
+
+#include <glm/glm.hpp>
+
+#include <common/OffscreenContext.h>
+#include <common/shader.h>
+#include <common/CoinRainEmitter.h>
+#include <common/GPUCoinRainEmitter.h>
+#include <common/GPUCoinRainRenderer.h>
+
+using namespace std;
+using namespace glm;
+
+#define SKIPPED 77
+
+// The ramp up adds 40 coins a second, after 3600 steps (60 s) all of them have been falling for a while
+#define NUM_COINS 2000
+#define STEPS 3600
+#define SEED 7
+
+struct sampleStats {
+    double mean = 0.0;
+    double variance = 0.0;
+};
+
+static sampleStats statsOf(const vector<float>& values) {
+    sampleStats stats;
+    if (values.empty()) return stats;
+    for (float v : values) stats.mean += v;
+    stats.mean /= values.size();
+    for (float v : values) stats.variance += (v - stats.mean) * (v - stats.mean);
+    stats.variance /= values.size();
+    return stats;
+}
+
+// tolerance: absolute, or relative to the CPU value
+static bool check(const char* name, double cpu, double gpu, double tolerance, bool relative = false) {
+    double allowed = relative ? tolerance * abs(cpu) : tolerance;
+    bool ok = abs(cpu - gpu) <= allowed;
+    cout << setw(18) << left << name << " cpu " << setw(12) << cpu << " gpu " << setw(12) << gpu
+         << (ok ? "ok" : "FAILED") << endl;
+    return ok;
+}
+
+int main() {
+    OffscreenContext* context;
+    try {
+        context = new OffscreenContext(16, 16);
+    }
+    catch (exception& ex) {
+        cout << "Skipped: " << ex.what() << endl;
+        return SKIPPED;
+    }
+
+    int result = 0;
+    try {
+        vec3 emitter_pos(0.0f, 20.0f, 0.0f);
+        float dt = 1.0f / 60.0f;
+
+        // No collision mesh and no separation, the GPU backend has neither
+        CoinRainEmitter cpu(NUM_COINS);
+        cpu.emitter_pos = emitter_pos;
+        cpu.use_separation = false;
+        cpu.seed(SEED);
+
+        GPUCoinRainEmitter gpu(NUM_COINS);
+        gpu.emitter_pos = emitter_pos;
+        gpu.seed(SEED);
+
+        GLuint update_program = loadTransformFeedbackShader(
+            "Shaders/particles-shaders/coinRainUpdate.vertexshader",
+            { "tf_position", "tf_mass", "tf_velocity", "tf_life", "tf_respawns" });
+        GPUCoinRainRenderer renderer(nullptr, update_program);
+
+        long cpu_killed = 0, gpu_killed = 0;
+        for (int step = 0; step < STEPS; step++) {
+            float time = step * dt;
+            cpu.updateParticles(time, dt);
+            cpu_killed += cpu.stats.killed;
+
+            gpu.updateParticles(time, dt);
+            gpu_killed += gpu.stats.killed;
+            renderer.simulate(gpu);
+            renderer.readRespawns(gpu, true);
+        }
+        // The deaths of the last step, the next update would report them
+        gpu_killed += gpu.gpu_respawns;
+
+        vector<float> cpu_y, cpu_life, gpu_y, gpu_life;
+        for (int i : cpu.alive_list) {
+            cpu_y.push_back(cpu.p_attributes[i].position.y);
+            cpu_life.push_back(cpu.p_attributes[i].life);
+        }
+        for (const gpuParticle& particle : renderer.readState(gpu.active_particles)) {
+            gpu_y.push_back(particle.position.y);
+            gpu_life.push_back(particle.life);
+        }
+        sampleStats cpu_y_stats = statsOf(cpu_y), gpu_y_stats = statsOf(gpu_y);
+        sampleStats cpu_life_stats = statsOf(cpu_life), gpu_life_stats = statsOf(gpu_life);
+
+        // A coin that falls through the floor waits a step for its respawn on the CPU, about 1.5%
+        // of them. The means are about 4 standard errors apart at most, the variances 15%
+        cout << fixed << setprecision(4);
+        bool ok = true;
+        ok &= check("live", cpu.alive_list.size(), gpu.active_particles, 0.03 * NUM_COINS);
+        ok &= check("position.y mean", cpu_y_stats.mean, gpu_y_stats.mean, 0.75);
+        ok &= check("position.y var", cpu_y_stats.variance, gpu_y_stats.variance, 0.15, true);
+        ok &= check("life mean", cpu_life_stats.mean, gpu_life_stats.mean, 0.035);
+        ok &= check("life var", cpu_life_stats.variance, gpu_life_stats.variance, 0.15, true);
+        ok &= check("killed", cpu_killed, gpu_killed, 0.05, true);
+        result = ok ? 0 : 1;
+
+        glDeleteProgram(update_program);
+    }
+    catch (exception& ex) {
+        cout << ex.what() << endl;
+        result = 1;
+    }
+
+    delete context;
+    return result;
+}
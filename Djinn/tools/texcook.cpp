@@ -0,0 +1,97 @@
+// Cooks source images into .dtex files (see common/CookedTexture.h): the mip chain and the
+// block compression are done here once, instead of decoding and resampling on every launch.
+//
+//   texcook [--bc1 | --bc3 | --bc5] <image or directory>...
+//
+// Every image is written next to itself with the .dtex extension, directories are cooked
+// recursively (.png, .jpg, .tga, .bmp). Without a format, images with a "normal" in the name are
+// BC5, images with alpha are BC3 and everything else is BC1. Run it from djinn/ on Textures/.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include <SOIL.h>
+
+#include <common/TextureCooker.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static bool isImage(const fs::path& path) {
+    string extension = path.extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" ||
+           extension == ".tga" || extension == ".bmp";
+}
+
+// 0 when no format was forced on the command line
+static cookedFormat chooseFormat(const fs::path& path, int channels, int forced) {
+    if (forced) return (cookedFormat) forced;
+    string name = path.filename().string();
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.find("normal") != string::npos) return COOKED_BC5;
+    return channels == 4 ? COOKED_BC3 : COOKED_BC1;
+}
+
+static void cookFile(const fs::path& path, int forced) {
+    auto start = chrono::steady_clock::now();
+
+    int width, height, channels;
+    unsigned char* rgba = SOIL_load_image(path.string().c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (!rgba) {
+        cout << "Can't read " << path.string() << ": " << SOIL_last_result() << endl;
+        return;
+    }
+    cookedFormat format = chooseFormat(path, channels, forced);
+    vector<cookedLevel> mips = cookTexture(rgba, width, height, format);
+    SOIL_free_image_data(rgba);
+
+    fs::path output = path;
+    output.replace_extension(".dtex");
+    writeCookedTexture(output.string(), format, mips);
+
+    float ms = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    cout << output.string() << ": " << width << "x" << height << " BC" << format << ", "
+         << mips.size() << " mips, " << fs::file_size(output) / 1024 << " KB (" << fs::file_size(path) / 1024
+         << " KB source, " << width * height * 4 / 1024 << " KB RGBA) in " << ms << " ms" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    int forced = 0;
+    vector<fs::path> inputs;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bc1") forced = COOKED_BC1;
+        else if (arg == "--bc3") forced = COOKED_BC3;
+        else if (arg == "--bc5") forced = COOKED_BC5;
+        else inputs.push_back(arg);
+    }
+    if (inputs.empty()) {
+        cout << "usage: texcook [--bc1 | --bc3 | --bc5] <image or directory>..." << endl;
+        return 1;
+    }
+
+    try
+    {
+        for (const fs::path& input : inputs) {
+            if (fs::is_directory(input)) {
+                for (const auto& entry : fs::recursive_directory_iterator(input)) {
+                    if (entry.is_regular_file() && isImage(entry.path())) cookFile(entry.path(), forced);
+                }
+            }
+            else {
+                cookFile(input, forced);
+            }
+        }
+    }
+    catch (exception& ex)
+    {
+        cout << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}